@@ -0,0 +1,325 @@
+#ifndef LIBCLOG_ALLOCATION_TRACKER_H
+#define LIBCLOG_ALLOCATION_TRACKER_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+#include "shared_memory.h"
+
+// Live allocations of one process, fed from the memmgmt event stream. Blocks are kept in an
+// open-addressing table keyed by pointer, with linear probing and backward-shift deletion, so a
+// lookup touches one or two cache lines and frees leave no tombstones behind. Call stacks are
+// deduplicated into a stack table and every live block refers to its stack by id; id 0 stands
+// for allocations logged without a call stack.
+//
+// Events of different threads reach the tracker out of order, across rings and drain cycles. Each
+// drained batch is sorted once by the ordering point of its events, after the call for allocations
+// and before it for frees, and applied; events ordered after the drain started wait for the next
+// batch, since rings read later may still hold what they depend on. An address handed out again
+// while it is still live has been freed by a thread whose event has not arrived yet: when the
+// process logs every free, the events of that address are held back in ordering point order until
+// the free comes in. A free still missing after MAX_HELD_EVENTS later events of its address, e.g.
+// in dropped records, is taken as lost.
+
+const uint32_t MAX_CALL_STACK_DEPTH = 8;
+const uint32_t ALLOCATION_TABLE_INITIAL_BITS = 12;
+const uint32_t STACK_TABLE_INITIAL_BITS = 8;
+const uint32_t NO_CALL_STACK = 0;
+const size_t MAX_HELD_EVENTS = 16;
+
+struct LiveAllocation {
+    uint64_t pointer;  // 0 marks an empty slot
+    uint64_t size;
+    uint32_t stack;
+};
+
+// An allocation or a free waiting to be applied
+struct QueuedAllocation {
+    uint64_t order;
+    uint64_t timestamp;
+    uint64_t pointer;
+    uint64_t size;
+    uint32_t stack;
+    bool allocation;
+};
+
+struct CallSite {
+    uint64_t frames[MAX_CALL_STACK_DEPTH];
+    uint32_t depth;
+    uint64_t live_bytes;
+    uint64_t live_count;
+    uint64_t reported_bytes;  // live_bytes at the previous report
+};
+
+inline uint64_t mixPointerHash(uint64_t value) {
+    return (value >> 4) * 0x9e3779b97f4a7c15ull;
+}
+
+inline uint64_t callStackHash(const uint64_t* frames, uint32_t depth) {
+    uint64_t hash = depth;
+    for (uint32_t index = 0; index < depth; ++index) {
+        hash = (hash ^ frames[index]) * 0x100000001b3ull;
+    }
+    return mixPointerHash(hash);
+}
+
+struct AllocationTracker {
+    std::vector<LiveAllocation> table;
+    uint32_t table_bits;
+    size_t table_used;
+    std::vector<CallSite> call_sites;
+    std::vector<uint32_t> stack_table;  // Open addressing over call site ids, 0 marks an empty slot
+    uint32_t stack_bits;
+
+    uint64_t live_bytes;
+    uint64_t live_count;
+    uint64_t peak_bytes;
+    uint64_t peak_timestamp;  // Raw clock of the event that reached peak_bytes
+    uint64_t allocated_count;
+    uint64_t freed_count;
+    uint64_t unknown_frees;   // Pointers freed without a logged allocation, e.g. below min_alloc
+    uint64_t live_size_counts[SIZE_HISTOGRAM_BUCKETS];
+    uint64_t live_size_bytes[SIZE_HISTOGRAM_BUCKETS];
+    std::vector<QueuedAllocation> batch;  // Events of the current drain cycle and those carried over
+    std::vector<QueuedAllocation> later;
+    // Events of addresses waiting for the free of their live block, in ordering point order
+    std::unordered_map<uint64_t, std::vector<QueuedAllocation>> held;
+    bool frees_complete;  // Every free is logged, so a live address handed out again will see its free
+
+    explicit AllocationTracker(bool frees_complete = false)
+        : table(size_t(1) << ALLOCATION_TABLE_INITIAL_BITS, LiveAllocation{0, 0, 0}),
+          table_bits(ALLOCATION_TABLE_INITIAL_BITS), table_used(0), call_sites(1, CallSite{}),
+          stack_table(size_t(1) << STACK_TABLE_INITIAL_BITS, 0), stack_bits(STACK_TABLE_INITIAL_BITS),
+          live_bytes(0), live_count(0), peak_bytes(0), peak_timestamp(0), allocated_count(0), freed_count(0),
+          unknown_frees(0), live_size_counts(), live_size_bytes(), frees_complete(frees_complete) {}
+
+    size_t homeSlot(uint64_t pointer) const {
+        return static_cast<size_t>(mixPointerHash(pointer) >> (64 - table_bits));
+    }
+
+    // Slot holding the pointer, or the empty slot where it would go
+    size_t findSlot(uint64_t pointer) const {
+        size_t mask = table.size() - 1;
+        size_t slot = homeSlot(pointer);
+        while (table[slot].pointer != 0 && table[slot].pointer != pointer) {
+            slot = (slot + 1) & mask;
+        }
+        return slot;
+    }
+
+    void growTable() {
+        std::vector<LiveAllocation> previous(table.size() * 2, LiveAllocation{0, 0, 0});
+        previous.swap(table);
+        ++table_bits;
+        for (const LiveAllocation& allocation : previous) {
+            if (allocation.pointer != 0) {
+                table[findSlot(allocation.pointer)] = allocation;
+            }
+        }
+    }
+
+    uint32_t internCallStack(const uint64_t* frames, uint32_t depth) {
+        if (depth == 0) {
+            return NO_CALL_STACK;
+        }
+        size_t mask = stack_table.size() - 1;
+        size_t slot = static_cast<size_t>(callStackHash(frames, depth) >> (64 - stack_bits));
+        for (; stack_table[slot] != 0; slot = (slot + 1) & mask) {
+            const CallSite& site = call_sites[stack_table[slot]];
+            if (site.depth == depth && memcmp(site.frames, frames, depth * sizeof(uint64_t)) == 0) {
+                return stack_table[slot];
+            }
+        }
+        uint32_t id = static_cast<uint32_t>(call_sites.size());
+        CallSite site = {};
+        memcpy(site.frames, frames, depth * sizeof(uint64_t));
+        site.depth = depth;
+        call_sites.push_back(site);
+        stack_table[slot] = id;
+        if (call_sites.size() * 2 > stack_table.size()) {
+            rehashStacks();
+        }
+        return id;
+    }
+
+    void rehashStacks() {
+        stack_table.assign(stack_table.size() * 2, 0);
+        ++stack_bits;
+        size_t mask = stack_table.size() - 1;
+        for (uint32_t id = 1; id < call_sites.size(); ++id) {
+            const CallSite& site = call_sites[id];
+            size_t slot = static_cast<size_t>(callStackHash(site.frames, site.depth) >> (64 - stack_bits));
+            while (stack_table[slot] != 0) {
+                slot = (slot + 1) & mask;
+            }
+            stack_table[slot] = id;
+        }
+    }
+
+    // Queue an allocation that returned at order; its call stack is interned right away
+    void queueAllocation(uint64_t pointer, uint64_t size, const uint64_t* frames, uint32_t depth, uint64_t order,
+                         uint64_t timestamp) {
+        if (pointer != 0) {
+            batch.push_back(QueuedAllocation{order, timestamp, pointer, size, internCallStack(frames, depth), true});
+        }
+    }
+
+    // Queue a free that started at order
+    void queueFree(uint64_t pointer, uint64_t order) {
+        if (pointer != 0) {
+            batch.push_back(QueuedAllocation{order, 0, pointer, 0, NO_CALL_STACK, false});
+        }
+    }
+
+    // Apply the batch in ordering point order. Events ordered from horizon on, the start of the
+    // drain, are carried over to the next batch; UINT64_MAX applies everything, held events
+    // included, as nothing more arrives.
+    void applyBatch(uint64_t horizon) {
+        // Mostly in order already: rings are read in call start order and calls are short
+        std::stable_sort(batch.begin(), batch.end(),
+                         [](const QueuedAllocation& left, const QueuedAllocation& right) { return left.order < right.order; });
+        later.clear();
+        for (const QueuedAllocation& queued : batch) {
+            if (queued.order >= horizon) {
+                later.push_back(queued);
+            } else if (queued.allocation) {
+                applyAllocation(queued);
+            } else {
+                applyFree(queued);
+            }
+        }
+        batch.swap(later);
+        if (horizon == UINT64_MAX) {
+            for (auto& waiting : held) {
+                for (const QueuedAllocation& queued : waiting.second) {
+                    apply(queued);
+                }
+            }
+            held.clear();
+        }
+    }
+
+    void apply(const QueuedAllocation& queued) {
+        if (queued.allocation) {
+            allocate(queued.pointer, queued.size, queued.stack, queued.timestamp);
+        } else {
+            free(queued.pointer);
+        }
+    }
+
+    void applyAllocation(const QueuedAllocation& queued) {
+        if (!frees_complete) {
+            apply(queued);
+            return;
+        }
+        auto waiting = held.empty() ? held.end() : held.find(queued.pointer);
+        if (waiting != held.end()) {
+            hold(waiting, queued);
+        } else if (table[findSlot(queued.pointer)].pointer != 0) {
+            held[queued.pointer].push_back(queued);
+        } else {
+            apply(queued);
+        }
+    }
+
+    void applyFree(const QueuedAllocation& queued) {
+        auto waiting = held.empty() ? held.end() : held.find(queued.pointer);
+        if (waiting != held.end()) {
+            hold(waiting, queued);
+        } else {
+            apply(queued);
+        }
+    }
+
+    // Add an event to the held ones of its address, then apply them up to the next allocation
+    // that still finds the address live
+    void hold(std::unordered_map<uint64_t, std::vector<QueuedAllocation>>::iterator waiting,
+              const QueuedAllocation& queued) {
+        std::vector<QueuedAllocation>& events = waiting->second;
+        events.insert(std::upper_bound(events.begin(), events.end(), queued,
+                                       [](const QueuedAllocation& left, const QueuedAllocation& right) {
+                                           return left.order < right.order;
+                                       }),
+                      queued);
+        size_t next = 0;
+        for (; next < events.size(); ++next) {
+            if (events[next].allocation && table[findSlot(waiting->first)].pointer != 0 &&
+                events.size() - next <= MAX_HELD_EVENTS) {
+                break;
+            }
+            apply(events[next]);
+        }
+        events.erase(events.begin(), events.begin() + next);
+        if (events.empty()) {
+            held.erase(waiting);
+        }
+    }
+
+    void allocate(uint64_t pointer, uint64_t size, uint32_t stack, uint64_t timestamp) {
+        if (pointer == 0) {
+            return;
+        }
+        if ((table_used + 1) * 2 > table.size()) {
+            growTable();
+        }
+        size_t slot = findSlot(pointer);
+        if (table[slot].pointer != 0) {
+            // A pointer handed out again without a logged free replaces the old block
+            release(pointer);
+            slot = findSlot(pointer);
+        }
+        table[slot] = LiveAllocation{pointer, size, stack};
+        ++table_used;
+        ++allocated_count;
+        ++live_count;
+        live_bytes += size;
+        ++live_size_counts[sizeBucket(size)];
+        live_size_bytes[sizeBucket(size)] += size;
+        call_sites[stack].live_bytes += size;
+        ++call_sites[stack].live_count;
+        if (live_bytes > peak_bytes) {
+            peak_bytes = live_bytes;
+            peak_timestamp = timestamp;
+        }
+    }
+
+    // Returns false when the pointer is not a live block
+    bool release(uint64_t pointer) {
+        size_t mask = table.size() - 1;
+        size_t hole = findSlot(pointer);
+        if (table[hole].pointer == 0) {
+            return false;
+        }
+        const LiveAllocation& allocation = table[hole];
+        live_bytes -= allocation.size;
+        --live_count;
+        --live_size_counts[sizeBucket(allocation.size)];
+        live_size_bytes[sizeBucket(allocation.size)] -= allocation.size;
+        call_sites[allocation.stack].live_bytes -= allocation.size;
+        --call_sites[allocation.stack].live_count;
+        ++freed_count;
+        --table_used;
+
+        // Pull later entries of the probe run back into the hole unless that would move them before their home slot
+        for (size_t next = (hole + 1) & mask; table[next].pointer != 0; next = (next + 1) & mask) {
+            size_t home = homeSlot(table[next].pointer);
+            if (((next - home) & mask) >= ((next - hole) & mask)) {
+                table[hole] = table[next];
+                hole = next;
+            }
+        }
+        table[hole].pointer = 0;
+        return true;
+    }
+
+    void free(uint64_t pointer) {
+        if (pointer != 0 && !release(pointer)) {
+            ++unknown_frees;
+        }
+    }
+};
+
+#endif // LIBCLOG_ALLOCATION_TRACKER_H
@@ -0,0 +1,611 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <deque>
+#include <cinttypes>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <csignal>
+#include <ctime>
+#include <fcntl.h>
+#include <getopt.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "allocation_tracker.h"
+#include "shared_memory.h"
+
+// Benchmark driver. Without arguments beyond options it orchestrates the whole suite from the
+// build directory: it starts ./daemon for both channels, re-executes itself as worker processes
+// with and without LD_PRELOAD=./liblibc_interceptor.so and writes the results as JSON.
+//
+//   benchmark [-i iterations] [-c calls_per_thread] [-t max_threads] [-p max_processes] [-s ring_size] [-o output.json]
+//   benchmark worker calls <iterations>            ns per call of every intercepted function
+//   benchmark worker load <threads> <calls>        1-byte writes to /dev/null from several threads
+
+const size_t CALL_BATCH = 256;
+const size_t LOAD_WRITE_SIZE = 1;
+const char* const FILEIO_LOG = "benchmark_fileio.log";
+const char* const MEMMGMT_LOG = "benchmark_memmgmt.log";
+const char* const INTERCEPTOR_LIBRARY = "./liblibc_interceptor.so";
+const char* const DAEMON_PROGRAM = "./daemon";
+const int DAEMON_START_TIMEOUT_MS = 5000;
+const uint64_t TRACKER_EVENTS = 2000000;
+const uint32_t TRACKER_EXCHANGE_SLOTS = 64;
+const uint32_t TRACKER_CALL_SITES = 16;
+const uint64_t TRACKER_DRAIN_INTERVAL = 100000;  // Raw clock ticks between drains
+const uint64_t TRACKER_COLLECT_WINDOW = 2000;    // Records published this long after a drain starts may still make it
+
+struct BenchmarkOptions {
+    uint64_t iterations;
+    uint64_t load_calls;
+    uint32_t max_threads;
+    uint32_t max_processes;
+    uint32_t ring_size;
+    const char* output_file;
+};
+
+// Allocator event of the synthetic tracker workload
+struct TrackerEvent {
+    uint64_t published;  // When the record reached its ring
+    uint64_t timestamp;
+    uint64_t duration;
+    uint64_t pointer;
+    uint64_t size;
+    uint32_t site;
+    bool allocation;
+};
+
+// One run of the load workload against a fresh pair of daemons
+struct LoadResult {
+    uint32_t processes;
+    uint32_t threads;
+    uint64_t calls;
+    double seconds;
+    uint64_t events_logged;
+    uint64_t events_dropped;
+    double daemon_seconds;
+    uint64_t log_bytes;
+};
+
+const char* const CALL_NAMES[] = {
+    "open", "close", "lseek", "read", "write", "malloc", "free", "calloc", "realloc",
+    "posix_memalign", "aligned_alloc", "memalign", "valloc"
+};
+const size_t CALL_COUNT = sizeof(CALL_NAMES) / sizeof(CALL_NAMES[0]);
+
+void handleError(bool condition, const char* error_message) {
+    if (condition) {
+        perror(error_message);
+        exit(EXIT_FAILURE);
+    }
+}
+
+uint64_t nowNanoseconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return timespecToNanoseconds(now);
+}
+
+// Keep the compiler from eliding allocations whose result is otherwise unused
+inline void keepValue(void* value) {
+    asm volatile("" : : "r"(value) : "memory");
+}
+
+template <typename Call>
+uint64_t timeCalls(size_t count, Call call) {
+    uint64_t start = nowNanoseconds();
+    for (size_t index = 0; index < count; ++index) {
+        call(index);
+    }
+    return nowNanoseconds() - start;
+}
+
+// Time every intercepted function in batches, so descriptors and blocks can be released untimed
+void runCallsWorker(uint64_t iterations) {
+    uint64_t elapsed[CALL_COUNT] = {};
+    int fds[CALL_BATCH];
+    void* pointers[CALL_BATCH];
+    char buffer[64] = {};
+    int null_fd = open("/dev/null", O_RDWR);
+    int zero_fd = open("/dev/zero", O_RDONLY);
+    handleError(null_fd == -1 || zero_fd == -1, "Failed to open /dev/null or /dev/zero");
+    uint64_t batches = (iterations + CALL_BATCH - 1) / CALL_BATCH;
+
+    auto freeBatch = [&]() {
+        for (size_t index = 0; index < CALL_BATCH; ++index) {
+            free(pointers[index]);
+        }
+    };
+    for (uint64_t batch = 0; batch < batches; ++batch) {
+        elapsed[0] += timeCalls(CALL_BATCH, [&](size_t index) { fds[index] = open("/dev/null", O_RDONLY); });
+        elapsed[1] += timeCalls(CALL_BATCH, [&](size_t index) { close(fds[index]); });
+        elapsed[2] += timeCalls(CALL_BATCH, [&](size_t) { lseek(null_fd, 0, SEEK_SET); });
+        elapsed[3] += timeCalls(CALL_BATCH, [&](size_t) { handleError(read(zero_fd, buffer, sizeof(buffer)) == -1, "read"); });
+        elapsed[4] += timeCalls(CALL_BATCH, [&](size_t) { handleError(write(null_fd, buffer, sizeof(buffer)) == -1, "write"); });
+        elapsed[5] += timeCalls(CALL_BATCH, [&](size_t index) { pointers[index] = malloc(64); keepValue(pointers[index]); });
+        elapsed[6] += timeCalls(CALL_BATCH, [&](size_t index) { free(pointers[index]); });
+        elapsed[7] += timeCalls(CALL_BATCH, [&](size_t index) { pointers[index] = calloc(1, 64); keepValue(pointers[index]); });
+        elapsed[8] += timeCalls(CALL_BATCH, [&](size_t index) { pointers[index] = realloc(pointers[index], 4096); keepValue(pointers[index]); });
+        freeBatch();
+        elapsed[9] += timeCalls(CALL_BATCH, [&](size_t index) { handleError(posix_memalign(&pointers[index], 64, 64) != 0, "posix_memalign"); });
+        freeBatch();
+        elapsed[10] += timeCalls(CALL_BATCH, [&](size_t index) { pointers[index] = aligned_alloc(64, 64); keepValue(pointers[index]); });
+        freeBatch();
+        elapsed[11] += timeCalls(CALL_BATCH, [&](size_t index) { pointers[index] = memalign(64, 64); keepValue(pointers[index]); });
+        freeBatch();
+        elapsed[12] += timeCalls(CALL_BATCH, [&](size_t index) { pointers[index] = valloc(64); keepValue(pointers[index]); });
+        freeBatch();
+    }
+    close(null_fd);
+    close(zero_fd);
+
+    for (size_t call = 0; call < CALL_COUNT; ++call) {
+        printf("%s %.1f\n", CALL_NAMES[call], static_cast<double>(elapsed[call]) / (batches * CALL_BATCH));
+    }
+}
+
+// Threads start together behind a barrier; prints the wall time from releasing the barrier until
+// every thread has joined
+void runLoadWorker(uint32_t thread_count, uint64_t calls) {
+    pthread_barrier_t barrier;
+    pthread_barrier_init(&barrier, nullptr, thread_count + 1);
+    int null_fd = open("/dev/null", O_WRONLY);
+    handleError(null_fd == -1, "Failed to open /dev/null");
+    std::vector<std::thread> threads;
+    for (uint32_t index = 0; index < thread_count; ++index) {
+        threads.emplace_back([&]() {
+            char byte = 0;
+            pthread_barrier_wait(&barrier);
+            for (uint64_t call = 0; call < calls; ++call) {
+                handleError(write(null_fd, &byte, LOAD_WRITE_SIZE) == -1, "write");
+            }
+        });
+    }
+    // The last arrival releases the barrier, the workers may be done before it returns here
+    uint64_t start = nowNanoseconds();
+    pthread_barrier_wait(&barrier);
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    uint64_t elapsed = nowNanoseconds() - start;
+    close(null_fd);
+    pthread_barrier_destroy(&barrier);
+    printf("%" PRIu64 "\n", elapsed);
+}
+
+pid_t spawnProcess(const std::vector<std::string>& arguments, bool preload, int stdout_fd) {
+    pid_t pid = fork();
+    handleError(pid == -1, "Failed to fork");
+    if (pid == 0) {
+        if (stdout_fd != -1) {
+            dup2(stdout_fd, STDOUT_FILENO);
+            close(stdout_fd);
+        }
+        if (preload) {
+            setenv("LD_PRELOAD", INTERCEPTOR_LIBRARY, 1);
+        } else {
+            unsetenv("LD_PRELOAD");
+        }
+        std::vector<char*> argv;
+        for (const std::string& argument : arguments) {
+            argv.push_back(const_cast<char*>(argument.c_str()));
+        }
+        argv.push_back(nullptr);
+        execv(argv[0], argv.data());
+        perror("Failed to exec");
+        _exit(EXIT_FAILURE);
+    }
+    return pid;
+}
+
+// Run worker processes concurrently and return the standard output of each
+std::vector<std::string> runWorkers(const std::vector<std::string>& arguments, uint32_t count, bool preload) {
+    std::vector<int> pipes;
+    std::vector<pid_t> pids;
+    for (uint32_t index = 0; index < count; ++index) {
+        int pipe_fds[2];
+        handleError(pipe(pipe_fds) == -1, "Failed to create pipe");
+        pids.push_back(spawnProcess(arguments, preload, pipe_fds[1]));
+        close(pipe_fds[1]);
+        pipes.push_back(pipe_fds[0]);
+    }
+    std::vector<std::string> outputs(count);
+    for (uint32_t index = 0; index < count; ++index) {
+        char buffer[4096];
+        ssize_t length;
+        while ((length = read(pipes[index], buffer, sizeof(buffer))) > 0) {
+            outputs[index].append(buffer, length);
+        }
+        close(pipes[index]);
+        int status = 0;
+        waitpid(pids[index], &status, 0);
+        handleError(!WIFEXITED(status) || WEXITSTATUS(status) != 0, "Benchmark worker failed");
+    }
+    return outputs;
+}
+
+// Wait until the daemon has published the channel registry
+void waitForDaemon(const char* shm_name) {
+    for (int waited = 0; waited < DAEMON_START_TIMEOUT_MS; waited += 10) {
+        int fd = shm_open(shm_name, O_RDONLY, 0);
+        if (fd != -1) {
+            struct stat shm_stat;
+            bool ready = false;
+            if (fstat(fd, &shm_stat) == 0 && static_cast<size_t>(shm_stat.st_size) >= sizeof(ChannelRegistry)) {
+                void* mapping = mmap(nullptr, sizeof(ChannelRegistry), PROT_READ, MAP_SHARED, fd, 0);
+                if (mapping != MAP_FAILED) {
+                    ready = static_cast<ChannelRegistry*>(mapping)->magic.load(std::memory_order_acquire) ==
+                            SHARED_MEMORY_MAGIC;
+                    munmap(mapping, sizeof(ChannelRegistry));
+                }
+            }
+            close(fd);
+            if (ready) {
+                return;
+            }
+        }
+        usleep(10000);
+    }
+    handleError(true, "Daemon did not start");
+}
+
+struct DaemonPair {
+    pid_t fileio;
+    pid_t memmgmt;
+};
+
+DaemonPair startDaemons(const BenchmarkOptions& options) {
+    unlink(FILEIO_LOG);
+    unlink(MEMMGMT_LOG);
+    shm_unlink(SHARED_MEMORY_FILEIO_NAME);
+    shm_unlink(SHARED_MEMORY_MEMMGMT_NAME);
+    std::string ring_size = std::to_string(options.ring_size);
+    DaemonPair daemons;
+    daemons.fileio = spawnProcess({DAEMON_PROGRAM, "-s", ring_size, "fileio", FILEIO_LOG, "1"}, false, -1);
+    daemons.memmgmt = spawnProcess({DAEMON_PROGRAM, "-s", ring_size, "memmgmt", MEMMGMT_LOG, "1"}, false, -1);
+    waitForDaemon(SHARED_MEMORY_FILEIO_NAME);
+    waitForDaemon(SHARED_MEMORY_MEMMGMT_NAME);
+    return daemons;
+}
+
+// SIGINT makes the daemons drain what is left; they have written everything once they exit
+void stopDaemons(const DaemonPair& daemons) {
+    kill(daemons.fileio, SIGINT);
+    kill(daemons.memmgmt, SIGINT);
+    waitpid(daemons.fileio, nullptr, 0);
+    waitpid(daemons.memmgmt, nullptr, 0);
+}
+
+// Count the rendered write events and the drops the daemon reported
+void parseFileioLog(LoadResult& result) {
+    FILE* log = fopen(FILEIO_LOG, "r");
+    handleError(log == nullptr, "Failed to open benchmark log");
+    char* line = nullptr;
+    size_t capacity = 0;
+    ssize_t length;
+    while ((length = getline(&line, &capacity, log)) != -1) {
+        result.log_bytes += length;
+        uint64_t dropped = 0;
+        if (strstr(line, ", write: ") != nullptr) {
+            ++result.events_logged;
+        } else if (sscanf(line, "[LibCLog] PID=%*u, ring=%*u, dropped=%" SCNu64, &dropped) == 1) {
+            result.events_dropped += dropped;
+        }
+    }
+    free(line);
+    fclose(log);
+}
+
+LoadResult runLoad(const BenchmarkOptions& options, uint32_t processes, uint32_t threads) {
+    LoadResult result = {processes, threads, static_cast<uint64_t>(processes) * threads * options.load_calls, 0, 0, 0, 0, 0};
+    DaemonPair daemons = startDaemons(options);
+    uint64_t start = nowNanoseconds();
+    std::vector<std::string> outputs = runWorkers({"/proc/self/exe", "worker", "load", std::to_string(threads),
+                                                   std::to_string(options.load_calls)}, processes, true);
+    stopDaemons(daemons);
+    result.daemon_seconds = (nowNanoseconds() - start) / 1e9;
+    uint64_t slowest = 0;
+    for (const std::string& output : outputs) {
+        slowest = std::max<uint64_t>(slowest, std::strtoull(output.c_str(), nullptr, 10));
+    }
+    result.seconds = slowest / 1e9;
+    parseFileioLog(result);
+    unlink(FILEIO_LOG);
+    unlink(MEMMGMT_LOG);
+    return result;
+}
+
+// Fill every ring of the fileio daemon while it is stopped, then time it draining them: from
+// resuming it, with SIGINT already pending, until it has written the last record and exited
+LoadResult runDrain(const BenchmarkOptions& options) {
+    // One ring per thread, ring 0 is left to overflow; more calls than a ring holds records
+    uint32_t threads = DEFAULT_RING_COUNT - 1;
+    uint64_t calls = options.ring_size / RECORD_ALIGNMENT;
+    LoadResult result = {options.max_processes, threads, static_cast<uint64_t>(options.max_processes) * threads * calls,
+                         0, 0, 0, 0, 0};
+    DaemonPair daemons = startDaemons(options);
+    kill(daemons.fileio, SIGSTOP);
+    runWorkers({"/proc/self/exe", "worker", "load", std::to_string(threads), std::to_string(calls)},
+               options.max_processes, true);
+    kill(daemons.fileio, SIGINT);
+    uint64_t start = nowNanoseconds();
+    kill(daemons.fileio, SIGCONT);
+    waitpid(daemons.fileio, nullptr, 0);
+    result.daemon_seconds = (nowNanoseconds() - start) / 1e9;
+    kill(daemons.memmgmt, SIGINT);
+    waitpid(daemons.memmgmt, nullptr, 0);
+    parseFileioLog(result);
+    unlink(FILEIO_LOG);
+    unlink(MEMMGMT_LOG);
+    return result;
+}
+
+inline uint64_t nextRandom(uint64_t& state) {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+// Threads freeing each other's blocks through exchange slots, with freed addresses handed out again
+// right away; 1 record in 1000 reaches its ring long after the call, as if its thread was preempted.
+// Returns the records in drain batches, each in call start order like the daemon renders them.
+std::vector<TrackerEvent> trackerWorkload(std::vector<size_t>& batch_ends, std::vector<uint64_t>& horizons,
+                                          uint64_t& live_blocks) {
+    std::vector<TrackerEvent> events;
+    std::deque<std::pair<uint64_t, uint64_t>> free_addresses;  // Address and the start of its free
+    uint64_t slots[TRACKER_EXCHANGE_SLOTS] = {};
+    uint64_t slot_published[TRACKER_EXCHANGE_SLOTS] = {};
+    uint64_t next_address = 0x10000000;
+    uint64_t clock = 0;
+    uint64_t random = 88172645463325252ull;
+    auto publishDelay = [&]() { return nextRandom(random) % 1000 == 0 ? 50 * TRACKER_DRAIN_INTERVAL : random % 200; };
+    while (events.size() + 2 <= TRACKER_EVENTS) {
+        clock += 20 + nextRandom(random) % 100;
+        uint64_t pointer = next_address;
+        if (!free_addresses.empty() && free_addresses.front().second < clock) {
+            pointer = free_addresses.front().first;
+            free_addresses.pop_front();
+        } else {
+            next_address += 4096;
+        }
+        uint64_t duration = 20 + nextRandom(random) % 400;
+        uint64_t published = clock + duration + publishDelay();
+        events.push_back(TrackerEvent{published, clock, duration, pointer, 64 + random % 4096,
+                                      static_cast<uint32_t>(random % TRACKER_CALL_SITES), true});
+
+        // The block reached its new owner only after its record was published
+        uint32_t slot = nextRandom(random) % TRACKER_EXCHANGE_SLOTS;
+        uint64_t previous = slots[slot];
+        uint64_t previous_published = slot_published[slot];
+        slots[slot] = pointer;
+        slot_published[slot] = published;
+        if (previous != 0) {
+            uint64_t start = std::max(clock + duration, previous_published + 1);
+            duration = 20 + nextRandom(random) % 200;
+            events.push_back(TrackerEvent{start + duration + publishDelay(), start, duration, previous, 0, 0, false});
+            free_addresses.emplace_back(previous, start);
+        }
+    }
+    live_blocks = 0;
+    for (uint64_t pointer : slots) {
+        live_blocks += pointer != 0;
+    }
+
+    // A drain takes what was published before it started, and some of what came in while it read the rings
+    std::sort(events.begin(), events.end(),
+              [](const TrackerEvent& left, const TrackerEvent& right) { return left.published < right.published; });
+    std::vector<TrackerEvent> batches;
+    std::vector<TrackerEvent> batch;
+    std::vector<TrackerEvent> carried;
+    size_t next = 0;
+    for (uint64_t drain = TRACKER_DRAIN_INTERVAL; next < events.size() || !carried.empty(); drain += TRACKER_DRAIN_INTERVAL) {
+        batch.swap(carried);
+        carried.clear();
+        for (; next < events.size() && events[next].published < drain + TRACKER_COLLECT_WINDOW; ++next) {
+            (events[next].published < drain || nextRandom(random) % 2 == 0 ? batch : carried).push_back(events[next]);
+        }
+        std::stable_sort(batch.begin(), batch.end(),
+                         [](const TrackerEvent& left, const TrackerEvent& right) { return left.timestamp < right.timestamp; });
+        batches.insert(batches.end(), batch.begin(), batch.end());
+        batch_ends.push_back(batches.size());
+        horizons.push_back(drain);
+        batch.clear();
+    }
+    return batches;
+}
+
+// Allocator events per second the daemon's tracker applies; fails unless exactly the blocks still
+// in the exchange slots are left live
+std::string trackerJson() {
+    std::vector<size_t> batch_ends;
+    std::vector<uint64_t> horizons;
+    uint64_t live_blocks = 0;
+    std::vector<TrackerEvent> events = trackerWorkload(batch_ends, horizons, live_blocks);
+    uint64_t frames[TRACKER_CALL_SITES][4];
+    for (uint32_t site = 0; site < TRACKER_CALL_SITES; ++site) {
+        for (uint32_t frame = 0; frame < 4; ++frame) {
+            frames[site][frame] = 0x400000 + site * 0x1000 + frame * 0x10;
+        }
+    }
+
+    AllocationTracker tracker(true);
+    uint64_t start = nowNanoseconds();
+    size_t index = 0;
+    for (size_t batch = 0; batch < batch_ends.size(); ++batch) {
+        for (; index < batch_ends[batch]; ++index) {
+            const TrackerEvent& event = events[index];
+            if (event.allocation) {
+                tracker.queueAllocation(event.pointer, event.size, frames[event.site], 4, event.timestamp + event.duration,
+                                        event.timestamp);
+            } else {
+                tracker.queueFree(event.pointer, event.timestamp);
+            }
+        }
+        tracker.applyBatch(horizons[batch]);
+    }
+    tracker.applyBatch(UINT64_MAX);
+    double seconds = (nowNanoseconds() - start) / 1e9;
+    if (tracker.live_count != live_blocks || tracker.unknown_frees != 0) {
+        fprintf(stderr, "Allocation tracker left %" PRIu64 " blocks live instead of %" PRIu64 ", unknown_frees=%" PRIu64 "\n",
+                tracker.live_count, live_blocks, tracker.unknown_frees);
+        exit(EXIT_FAILURE);
+    }
+    char json[256];
+    snprintf(json, sizeof(json), "{\"events\": %zu, \"seconds\": %.6f, \"events_per_second\": %.0f}", events.size(),
+             seconds, seconds > 0 ? events.size() / seconds : 0.0);
+    return json;
+}
+
+// "name value" lines of a calls worker as a JSON object
+std::string callsJson(const std::string& output) {
+    std::string json = "{";
+    char name[64];
+    double value;
+    const char* cursor = output.c_str();
+    int consumed = 0;
+    while (sscanf(cursor, "%63s %lf\n%n", name, &value, &consumed) == 2) {
+        char entry[128];
+        snprintf(entry, sizeof(entry), "%s\"%s\": %.1f", json.size() > 1 ? ", " : "", name, value);
+        json += entry;
+        cursor += consumed;
+    }
+    return json + "}";
+}
+
+std::string loadJson(const LoadResult& result) {
+    uint64_t attempted = result.events_logged + result.events_dropped;
+    char json[512];
+    snprintf(json, sizeof(json),
+             "{\"processes\": %u, \"threads\": %u, \"calls\": %" PRIu64 ", \"seconds\": %.6f, \"calls_per_second\": %.0f, "
+             "\"events_logged\": %" PRIu64 ", \"events_dropped\": %" PRIu64 ", \"drop_rate\": %.6f, "
+             "\"daemon_seconds\": %.6f, \"daemon_events_per_second\": %.0f, \"daemon_log_bytes_per_second\": %.0f}",
+             result.processes, result.threads, result.calls, result.seconds,
+             result.seconds > 0 ? result.calls / result.seconds : 0.0, result.events_logged, result.events_dropped,
+             attempted != 0 ? static_cast<double>(result.events_dropped) / attempted : 0.0, result.daemon_seconds,
+             result.daemon_seconds > 0 ? result.events_logged / result.daemon_seconds : 0.0,
+             result.daemon_seconds > 0 ? result.log_bytes / result.daemon_seconds : 0.0);
+    return json;
+}
+
+std::string drainJson(const LoadResult& result) {
+    char json[384];
+    snprintf(json, sizeof(json),
+             "{\"processes\": %u, \"threads\": %u, \"records\": %" PRIu64 ", \"records_dropped\": %" PRIu64
+             ", \"log_bytes\": %" PRIu64 ", \"seconds\": %.6f, \"records_per_second\": %.0f, \"bytes_per_second\": %.0f}",
+             result.processes, result.threads, result.events_logged, result.events_dropped, result.log_bytes,
+             result.daemon_seconds, result.daemon_seconds > 0 ? result.events_logged / result.daemon_seconds : 0.0,
+             result.daemon_seconds > 0 ? result.log_bytes / result.daemon_seconds : 0.0);
+    return json;
+}
+
+// 1, 2, 4, ... and finally the limit itself
+uint32_t nextScalingStep(uint32_t count, uint32_t limit) {
+    return count < limit && count * 2 > limit ? limit : count * 2;
+}
+
+std::string scalingJson(const BenchmarkOptions& options, bool by_processes) {
+    std::string json = "[";
+    uint32_t limit = by_processes ? options.max_processes : options.max_threads;
+    for (uint32_t count = 1; count <= limit; count = nextScalingStep(count, limit)) {
+        LoadResult result = runLoad(options, by_processes ? count : 1, by_processes ? 1 : count);
+        json += (json.size() > 1 ? ", " : "") + loadJson(result);
+        std::cerr << (by_processes ? "processes=" : "threads=") << count << " done" << std::endl;
+    }
+    return json + "]";
+}
+
+void runBenchmarks(const BenchmarkOptions& options) {
+    handleError(access(DAEMON_PROGRAM, X_OK) == -1 || access(INTERCEPTOR_LIBRARY, R_OK) == -1,
+                "Run the benchmark from the build directory");
+    std::string iterations = std::to_string(options.iterations);
+    std::string baseline = callsJson(runWorkers({"/proc/self/exe", "worker", "calls", iterations}, 1, false)[0]);
+    DaemonPair daemons = startDaemons(options);
+    std::string intercepted = callsJson(runWorkers({"/proc/self/exe", "worker", "calls", iterations}, 1, true)[0]);
+    stopDaemons(daemons);
+    unlink(FILEIO_LOG);
+    unlink(MEMMGMT_LOG);
+    std::cerr << "per-call done" << std::endl;
+
+    std::string thread_scaling = scalingJson(options, false);
+    std::string process_scaling = scalingJson(options, true);
+    std::string drain = drainJson(runDrain(options));
+    std::cerr << "daemon drain done" << std::endl;
+    std::string tracker = trackerJson();
+    std::cerr << "allocation tracker done" << std::endl;
+
+    FILE* output = options.output_file != nullptr ? fopen(options.output_file, "w") : stdout;
+    handleError(output == nullptr, "Failed to open benchmark output");
+    fprintf(output, "{\n  \"timestamp\": %ld,\n  \"iterations\": %" PRIu64 ",\n  \"calls_per_thread\": %" PRIu64
+            ",\n  \"ring_size\": %u,\n  \"per_call_ns\": {\n    \"baseline\": %s,\n    \"intercepted\": %s\n  },\n"
+            "  \"thread_scaling\": %s,\n  \"process_scaling\": %s,\n  \"daemon_drain\": %s,\n  \"allocation_tracker\": %s\n}\n",
+            static_cast<long>(time(nullptr)), options.iterations, options.load_calls, options.ring_size,
+            baseline.c_str(), intercepted.c_str(), thread_scaling.c_str(), process_scaling.c_str(),
+            drain.c_str(), tracker.c_str());
+    if (output != stdout) {
+        fclose(output);
+    }
+}
+
+void printUsage(const char* program_name) {
+    std::cerr << "Usage: " << program_name << " [-i iterations] [-c calls_per_thread] [-t max_threads]"
+              << " [-p max_processes] [-s ring_size_bytes] [-o output_json]" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc >= 4 && strcmp(argv[1], "worker") == 0) {
+        if (strcmp(argv[2], "calls") == 0) {
+            runCallsWorker(std::strtoull(argv[3], nullptr, 10));
+            return EXIT_SUCCESS;
+        }
+        if (strcmp(argv[2], "load") == 0 && argc == 5) {
+            runLoadWorker(static_cast<uint32_t>(std::strtoul(argv[3], nullptr, 10)), std::strtoull(argv[4], nullptr, 10));
+            return EXIT_SUCCESS;
+        }
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    BenchmarkOptions options = {100000, 50000, std::max(1u, std::thread::hardware_concurrency()), 4, DEFAULT_RING_SIZE, nullptr};
+    int option;
+    while ((option = getopt(argc, argv, "i:c:t:p:s:o:")) != -1) {
+        switch (option) {
+            case 'i':
+                options.iterations = std::strtoull(optarg, nullptr, 10);
+                break;
+            case 'c':
+                options.load_calls = std::strtoull(optarg, nullptr, 10);
+                break;
+            case 't':
+                options.max_threads = static_cast<uint32_t>(std::strtoul(optarg, nullptr, 10));
+                break;
+            case 'p':
+                options.max_processes = static_cast<uint32_t>(std::strtoul(optarg, nullptr, 10));
+                break;
+            case 's':
+                options.ring_size = static_cast<uint32_t>(std::strtoul(optarg, nullptr, 10));
+                break;
+            case 'o':
+                options.output_file = optarg;
+                break;
+            default:
+                printUsage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (optind != argc || options.iterations == 0 || options.max_threads == 0 || options.max_processes == 0) {
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    runBenchmarks(options);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,57 @@
+#ifndef LIBCLOG_BOOTSTRAP_ARENA_H
+#define LIBCLOG_BOOTSTRAP_ARENA_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Static bump arena for allocations made before the real allocator is resolved (dlsym may call
+// calloc). Blocks are never reused, so a new block is already zeroed. Each block is aligned to at
+// least BOOTSTRAP_ALIGNMENT and follows a BOOTSTRAP_ALIGNMENT-byte header whose last word holds
+// the requested size, for realloc. Kept zero-initialized in static storage, it needs no constructor.
+
+const size_t BOOTSTRAP_ALIGNMENT = 16;
+
+inline bool isPowerOfTwo(size_t value) {
+    return value != 0 && (value & (value - 1)) == 0;
+}
+
+template <size_t Size>
+struct BootstrapArena {
+    alignas(BOOTSTRAP_ALIGNMENT) char memory[Size];
+    std::atomic<size_t> offset;
+
+    // alignment must be a power of two; nullptr once the arena is exhausted
+    void* allocate(size_t size, size_t alignment = BOOTSTRAP_ALIGNMENT) {
+        if (alignment < BOOTSTRAP_ALIGNMENT) {
+            alignment = BOOTSTRAP_ALIGNMENT;
+        }
+        if (!isPowerOfTwo(alignment) || alignment > Size || size > Size) {
+            return nullptr;
+        }
+        uintptr_t base = reinterpret_cast<uintptr_t>(memory);
+        size_t current = offset.load(std::memory_order_relaxed);
+        size_t block;
+        size_t end;
+        do {
+            block = ((base + current + BOOTSTRAP_ALIGNMENT + alignment - 1) & ~(alignment - 1)) - base;
+            if (block + size > Size) {
+                return nullptr;
+            }
+            end = (block + size + BOOTSTRAP_ALIGNMENT - 1) & ~(BOOTSTRAP_ALIGNMENT - 1);
+        } while (!offset.compare_exchange_weak(current, end, std::memory_order_relaxed));
+        char* pointer = memory + block;
+        reinterpret_cast<size_t*>(pointer)[-1] = size;
+        return pointer;
+    }
+
+    bool contains(const void* pointer) const {
+        return pointer >= memory && pointer < memory + Size;
+    }
+
+    static size_t blockSize(const void* pointer) {
+        return reinterpret_cast<const size_t*>(pointer)[-1];
+    }
+};
+
+#endif
@@ -0,0 +1,87 @@
+#ifndef LIBCLOG_CLOCK_SOURCE_H
+#define LIBCLOG_CLOCK_SOURCE_H
+
+#include <cstdint>
+#include <ctime>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Raw event clocks. Producers only read the raw counter; the daemon picks the source,
+// publishes a wall-clock anchor in the shared memory header and converts raw values
+// to calendar time when rendering.
+
+enum ClockSource : uint32_t {
+    CLOCK_SOURCE_TSC,               // rdtsc, calibrated against CLOCK_MONOTONIC by the daemon
+    CLOCK_SOURCE_MONOTONIC,         // CLOCK_MONOTONIC through the vDSO, nanoseconds
+    CLOCK_SOURCE_MONOTONIC_COARSE,  // CLOCK_MONOTONIC_COARSE through the vDSO, tick resolution
+    CLOCK_SOURCE_COUNT
+};
+
+// Raw reading and wall clock taken at the same instant
+struct ClockAnchor {
+    uint64_t raw;
+    uint64_t realtime_ns;
+    uint64_t ticks_per_second;
+};
+
+inline uint64_t timespecToNanoseconds(const struct timespec& time) {
+    return static_cast<uint64_t>(time.tv_sec) * 1000000000ull + static_cast<uint64_t>(time.tv_nsec);
+}
+
+inline bool isTscAvailable() {
+#if defined(__x86_64__) || defined(__i386__)
+    return true;
+#else
+    return false;
+#endif
+}
+
+inline uint64_t readTscClock() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+inline uint64_t readMonotonicClock() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return timespecToNanoseconds(now);
+}
+
+inline uint64_t readMonotonicCoarseClock() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+    return timespecToNanoseconds(now);
+}
+
+typedef uint64_t (*RawClockReader)();
+
+inline RawClockReader rawClockReader(uint32_t source) {
+    switch (source) {
+        case CLOCK_SOURCE_TSC:
+            return isTscAvailable() ? readTscClock : readMonotonicClock;
+        case CLOCK_SOURCE_MONOTONIC_COARSE:
+            return readMonotonicCoarseClock;
+        default:
+            return readMonotonicClock;
+    }
+}
+
+inline uint64_t rawClockToRealtime(const ClockAnchor& anchor, uint64_t raw) {
+    __int128 delta = static_cast<__int128>(raw) - static_cast<__int128>(anchor.raw);
+    return static_cast<uint64_t>(static_cast<__int128>(anchor.realtime_ns) +
+                                 delta * 1000000000 / static_cast<__int128>(anchor.ticks_per_second));
+}
+
+inline uint64_t rawClockToNanoseconds(const ClockAnchor& anchor, uint64_t ticks) {
+    return static_cast<uint64_t>(static_cast<unsigned __int128>(ticks) * 1000000000ull / anchor.ticks_per_second);
+}
+
+inline uint64_t nanosecondsToRawClock(const ClockAnchor& anchor, uint64_t nanoseconds) {
+    return static_cast<uint64_t>(static_cast<unsigned __int128>(nanoseconds) * anchor.ticks_per_second / 1000000000ull);
+}
+
+#endif // LIBCLOG_CLOCK_SOURCE_H
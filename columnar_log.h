@@ -0,0 +1,352 @@
+#ifndef LIBCLOG_COLUMNAR_LOG_H
+#define LIBCLOG_COLUMNAR_LOG_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "clock_source.h"
+#include "event_record.h"
+
+// Columnar event log written by the daemon with -C and read by libclog-query.
+//
+//   [ColumnBlockHeader][column 0][column 1]...[column COLUMN_COUNT - 1]  repeated
+//
+// Every block is self-contained: its header carries the clock anchor, the row count, the byte
+// size of each column and the index used to skip it (timestamp range, PID range and bitmap,
+// opcode mask), so rotated or concatenated files stay readable. Numbers are LEB128 varints;
+// timestamps and thread ids are delta-encoded against the previous row, arguments and results
+// against the previous row with the same opcode, zigzagged so small negative deltas stay short.
+// Paths, call stacks, process names and the paths of descriptors go to a string table stored
+// once per block.
+
+const uint32_t COLUMN_BLOCK_MAGIC = 0x4b4c4243; // "CBLK"
+const uint32_t COLUMN_FORMAT_VERSION = 2;
+const uint32_t COLUMN_BLOCK_MAX_ROWS = 65536;
+const size_t COLUMN_BLOCK_MAX_BYTES = 8 << 20;
+const uint32_t PID_BITMAP_WORDS = 4;
+
+enum Column {
+    COLUMN_TIMESTAMP,       // zigzag delta
+    COLUMN_DURATION,        // varint
+    COLUMN_PROCESS,         // index into the process table
+    COLUMN_TID,             // zigzag delta
+    COLUMN_OPCODE,          // one byte
+    COLUMN_ARGUMENT_COUNT,  // one byte
+    COLUMN_ARGUMENTS,       // zigzag delta per opcode and position
+    COLUMN_RESULT,          // zigzag delta per opcode
+    COLUMN_STRING,          // string table index + 1, 0 without a string
+    COLUMN_FILE,            // string table index + 1 of the descriptor's path, 0 without one
+    COLUMN_PROCESS_TABLE,   // count, then pid and name string index per process
+    COLUMN_STRING_TABLE,    // count, then length and bytes per string
+    COLUMN_COUNT
+};
+
+struct ColumnBlockHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t row_count;
+    uint32_t reserved;
+    uint64_t block_size;  // Bytes of the columns following the header
+    ClockAnchor clock_anchor;
+    uint64_t min_timestamp;  // Raw clock
+    uint64_t max_timestamp;
+    uint64_t opcode_mask;
+    uint32_t min_pid;
+    uint32_t max_pid;
+    uint64_t pid_bitmap[PID_BITMAP_WORDS];  // Bit pid % 256 is set for every PID in the block
+    uint64_t column_sizes[COLUMN_COUNT];
+};
+
+// Copy out the header of the block at offset, blocks are not aligned. Returns false when the file
+// ends before the header or the columns do, or the header is not a block of this format.
+inline bool readColumnBlockHeader(const uint8_t* data, size_t size, size_t offset, ColumnBlockHeader& header) {
+    if (offset > size || size - offset < sizeof(header)) {
+        return false;
+    }
+    memcpy(&header, data + offset, sizeof(header));
+    return header.magic == COLUMN_BLOCK_MAGIC && header.version == COLUMN_FORMAT_VERSION &&
+           header.block_size <= size - offset - sizeof(header);
+}
+
+inline bool isPidInBitmap(const uint64_t* bitmap, uint32_t pid) {
+    uint32_t bit = pid % (PID_BITMAP_WORDS * 64);
+    return (bitmap[bit / 64] >> (bit % 64)) & 1u;
+}
+
+inline uint64_t zigzagEncode(int64_t value) {
+    return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+inline int64_t zigzagDecode(uint64_t value) {
+    return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+inline void appendVarint(std::vector<uint8_t>& column, uint64_t value) {
+    while (value >= 0x80) {
+        column.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    column.push_back(static_cast<uint8_t>(value));
+}
+
+// Reads a column, past its end every read returns 0
+struct ColumnReader {
+    const uint8_t* position;
+    const uint8_t* end;
+
+    uint64_t varint() {
+        uint64_t value = 0;
+        for (uint32_t shift = 0; position < end && shift < 64; shift += 7) {
+            uint8_t byte = *position++;
+            value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            if ((byte & 0x80) == 0) {
+                break;
+            }
+        }
+        return value;
+    }
+
+    uint8_t byte() {
+        return position < end ? *position++ : 0;
+    }
+
+    const uint8_t* bytes(size_t length) {
+        if (static_cast<size_t>(end - position) < length) {
+            position = end;
+            return nullptr;
+        }
+        const uint8_t* data = position;
+        position += length;
+        return data;
+    }
+};
+
+// Delta state shared by the encoder and decoder, reset at every block
+struct ColumnDeltaState {
+    uint64_t timestamp;
+    uint32_t tid;
+    uint64_t arguments[OP_COUNT][MAX_EVENT_ARGUMENTS];
+    int64_t results[OP_COUNT];
+
+    void reset() {
+        memset(this, 0, sizeof(*this));
+    }
+};
+
+// Accumulates rows of the current block; the daemon flushes it when it is full or old enough
+struct ColumnBlockEncoder {
+    ColumnBlockHeader header;
+    std::vector<uint8_t> columns[COLUMN_COUNT];
+    ColumnDeltaState delta;
+    std::unordered_map<std::string, uint32_t> string_ids;
+    std::vector<const std::string*> strings;
+    std::unordered_map<uint32_t, uint32_t> process_ids;
+    std::vector<std::pair<uint32_t, uint32_t>> processes;  // pid, name string index
+    size_t string_bytes;
+
+    ColumnBlockEncoder() {
+        reset();
+    }
+
+    void reset() {
+        memset(&header, 0, sizeof(header));
+        header.magic = COLUMN_BLOCK_MAGIC;
+        header.version = COLUMN_FORMAT_VERSION;
+        header.min_timestamp = UINT64_MAX;
+        header.min_pid = UINT32_MAX;
+        for (std::vector<uint8_t>& column : columns) {
+            column.clear();
+        }
+        delta.reset();
+        string_ids.clear();
+        strings.clear();
+        process_ids.clear();
+        processes.clear();
+        string_bytes = 0;
+    }
+
+    uint32_t internString(const char* data, size_t length) {
+        auto interned = string_ids.emplace(std::string(data, length), static_cast<uint32_t>(strings.size()));
+        if (interned.second) {
+            strings.push_back(&interned.first->first);
+            string_bytes += length;
+        }
+        return interned.first->second;
+    }
+
+    uint32_t internProcess(uint32_t pid, const std::string& name) {
+        auto interned = process_ids.emplace(pid, static_cast<uint32_t>(processes.size()));
+        if (interned.second) {
+            processes.emplace_back(pid, internString(name.data(), name.size()));
+        }
+        return interned.first->second;
+    }
+
+    void append(const EventRecord* event, uint32_t pid, const std::string& process_name, const std::string* path) {
+        uint32_t opcode = event->opcode < OP_COUNT ? event->opcode : 0;
+        appendVarint(columns[COLUMN_TIMESTAMP], zigzagEncode(static_cast<int64_t>(event->timestamp - delta.timestamp)));
+        delta.timestamp = event->timestamp;
+        appendVarint(columns[COLUMN_DURATION], event->duration);
+        appendVarint(columns[COLUMN_PROCESS], internProcess(pid, process_name));
+        appendVarint(columns[COLUMN_TID], zigzagEncode(static_cast<int64_t>(event->tid) - static_cast<int64_t>(delta.tid)));
+        delta.tid = event->tid;
+        columns[COLUMN_OPCODE].push_back(event->opcode);
+        columns[COLUMN_ARGUMENT_COUNT].push_back(event->argument_count);
+        for (uint32_t index = 0; index < event->argument_count; ++index) {
+            uint64_t value = eventArguments(event)[index];
+            appendVarint(columns[COLUMN_ARGUMENTS], zigzagEncode(static_cast<int64_t>(value - delta.arguments[opcode][index])));
+            delta.arguments[opcode][index] = value;
+        }
+        appendVarint(columns[COLUMN_RESULT], zigzagEncode(static_cast<int64_t>(static_cast<uint64_t>(event->result) -
+                                                                               static_cast<uint64_t>(delta.results[opcode]))));
+        delta.results[opcode] = event->result;
+        appendVarint(columns[COLUMN_STRING],
+                     event->string_length != 0 ? internString(eventString(event), event->string_length) + 1 : 0);
+        appendVarint(columns[COLUMN_FILE], path != nullptr && !path->empty() ? internString(path->data(), path->size()) + 1 : 0);
+
+        ++header.row_count;
+        header.min_timestamp = std::min(header.min_timestamp, event->timestamp);
+        header.max_timestamp = std::max(header.max_timestamp, event->timestamp);
+        header.opcode_mask |= 1ull << opcode;
+        header.min_pid = std::min(header.min_pid, pid);
+        header.max_pid = std::max(header.max_pid, pid);
+        uint32_t bit = pid % (PID_BITMAP_WORDS * 64);
+        header.pid_bitmap[bit / 64] |= 1ull << (bit % 64);
+    }
+
+    size_t encodedSize() const {
+        size_t size = string_bytes;
+        for (const std::vector<uint8_t>& column : columns) {
+            size += column.size();
+        }
+        return size;
+    }
+
+    bool isFull() const {
+        return header.row_count >= COLUMN_BLOCK_MAX_ROWS || encodedSize() >= COLUMN_BLOCK_MAX_BYTES;
+    }
+
+    // Write the tables and fill in the header; the block is then the header followed by the columns
+    void finish(const ClockAnchor& clock_anchor) {
+        std::vector<uint8_t>& process_table = columns[COLUMN_PROCESS_TABLE];
+        appendVarint(process_table, processes.size());
+        for (const std::pair<uint32_t, uint32_t>& process : processes) {
+            appendVarint(process_table, process.first);
+            appendVarint(process_table, process.second);
+        }
+        std::vector<uint8_t>& string_table = columns[COLUMN_STRING_TABLE];
+        appendVarint(string_table, strings.size());
+        for (const std::string* string : strings) {
+            appendVarint(string_table, string->size());
+            string_table.insert(string_table.end(), string->begin(), string->end());
+        }
+        header.clock_anchor = clock_anchor;
+        header.block_size = 0;
+        for (uint32_t column = 0; column < COLUMN_COUNT; ++column) {
+            header.column_sizes[column] = columns[column].size();
+            header.block_size += columns[column].size();
+        }
+    }
+};
+
+// Decodes the rows of one block into event records, in the layout the daemon renders
+struct ColumnBlockDecoder {
+    const ColumnBlockHeader* header;
+    ColumnReader readers[COLUMN_COUNT];
+    ColumnDeltaState delta;
+    std::vector<std::pair<const char*, uint32_t>> strings;
+    std::vector<std::pair<uint32_t, uint32_t>> processes;
+    uint32_t remaining_rows;
+    alignas(EventRecord) char record[sizeof(EventRecord) + MAX_EVENT_ARGUMENTS * sizeof(uint64_t) + MAX_EVENT_STRING_LENGTH + 1];
+
+    // Columns follow the header in the file, which is read into a copy since blocks are not aligned.
+    // Returns false when the column sizes do not add up to the block size.
+    bool open(const ColumnBlockHeader* block_header, const uint8_t* position) {
+        header = block_header;
+        uint64_t total = 0;
+        for (uint32_t column = 0; column < COLUMN_COUNT; ++column) {
+            readers[column] = ColumnReader{position, position + header->column_sizes[column]};
+            position += header->column_sizes[column];
+            total += header->column_sizes[column];
+        }
+        if (total != header->block_size) {
+            return false;
+        }
+        ColumnReader& string_table = readers[COLUMN_STRING_TABLE];
+        strings.resize(string_table.varint());
+        for (std::pair<const char*, uint32_t>& string : strings) {
+            uint32_t length = static_cast<uint32_t>(string_table.varint());
+            const uint8_t* data = string_table.bytes(length);
+            string = std::make_pair(data != nullptr ? reinterpret_cast<const char*>(data) : "", data != nullptr ? length : 0);
+        }
+        ColumnReader& process_table = readers[COLUMN_PROCESS_TABLE];
+        processes.resize(process_table.varint());
+        for (std::pair<uint32_t, uint32_t>& process : processes) {
+            process.first = static_cast<uint32_t>(process_table.varint());
+            process.second = static_cast<uint32_t>(process_table.varint());
+        }
+        delta.reset();
+        remaining_rows = header->row_count;
+        return true;
+    }
+
+    // Decode the next row; pid and process name come from the process table, path is empty without one
+    const EventRecord* next(uint32_t& pid, const char*& process_name, uint32_t& process_name_length, const char*& path,
+                            uint32_t& path_length) {
+        if (remaining_rows == 0) {
+            return nullptr;
+        }
+        --remaining_rows;
+        EventRecord* event = reinterpret_cast<EventRecord*>(record);
+        delta.timestamp += static_cast<uint64_t>(zigzagDecode(readers[COLUMN_TIMESTAMP].varint()));
+        event->timestamp = delta.timestamp;
+        event->duration = readers[COLUMN_DURATION].varint();
+        uint64_t process = readers[COLUMN_PROCESS].varint();
+        delta.tid = static_cast<uint32_t>(static_cast<int64_t>(delta.tid) + zigzagDecode(readers[COLUMN_TID].varint()));
+        event->tid = delta.tid;
+        event->opcode = readers[COLUMN_OPCODE].byte();
+        event->argument_count = std::min<uint8_t>(readers[COLUMN_ARGUMENT_COUNT].byte(), MAX_EVENT_ARGUMENTS);
+        uint32_t opcode = event->opcode < OP_COUNT ? event->opcode : 0;
+        uint64_t* arguments = reinterpret_cast<uint64_t*>(event + 1);
+        for (uint32_t index = 0; index < event->argument_count; ++index) {
+            delta.arguments[opcode][index] += static_cast<uint64_t>(zigzagDecode(readers[COLUMN_ARGUMENTS].varint()));
+            arguments[index] = delta.arguments[opcode][index];
+        }
+        delta.results[opcode] = static_cast<int64_t>(static_cast<uint64_t>(delta.results[opcode]) +
+                                                     static_cast<uint64_t>(zigzagDecode(readers[COLUMN_RESULT].varint())));
+        event->result = delta.results[opcode];
+        uint64_t string = readers[COLUMN_STRING].varint();
+        event->string_length = 0;
+        if (string != 0 && string <= strings.size()) {
+            uint32_t length = std::min<uint32_t>(strings[string - 1].second, MAX_EVENT_STRING_LENGTH);
+            memcpy(const_cast<char*>(eventString(event)), strings[string - 1].first, length);
+            event->string_length = static_cast<uint16_t>(length);
+        }
+        event->file = NO_PATH;
+        event->reserved = 0;
+        uint64_t file = readers[COLUMN_FILE].varint();
+        path = "";
+        path_length = 0;
+        if (file != 0 && file <= strings.size()) {
+            path = strings[file - 1].first;
+            path_length = strings[file - 1].second;
+        }
+
+        pid = 0;
+        process_name = "";
+        process_name_length = 0;
+        if (process < processes.size()) {
+            pid = processes[process].first;
+            if (processes[process].second < strings.size()) {
+                process_name = strings[processes[process].second].first;
+                process_name_length = strings[processes[process].second].second;
+            }
+        }
+        return event;
+    }
+};
+
+#endif // LIBCLOG_COLUMNAR_LOG_H
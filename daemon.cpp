@@ -1,89 +1,1375 @@
-#include <iostream>
-#include <fstream>
-#include <cstring>
-#include <csignal>
-#include <sys/mman.h>
-#include <sys/stat.h>
-#include <fcntl.h>
-#include <unistd.h>
-
-// Constants
-const int SHARED_MEMORY_SIZE = 4096;
-char* SHARED_MEMORY_NAME = "/shm_"; 
-
-struct SharedMemoryData {
-    int offset;
-    char buffer[SHARED_MEMORY_SIZE - sizeof(int)];
-};
-
-// Shared resources
-SharedMemoryData* shared_memory_data = nullptr;
-int shared_memory_fd = -1;
-std::ofstream log_file;
-
-// Error checking utility
-void handleError(bool condition, const char* error_message) {
-    if (condition) {
-        perror(error_message);
-        exit(EXIT_FAILURE);
-    }
-}
-
-// Signal handler for cleanup on SIGINT
-void signalHandler(int signal) {
-    if (signal == SIGINT) {
-        munmap(shared_memory_data, SHARED_MEMORY_SIZE);
-        close(shared_memory_fd);
-        shm_unlink(SHARED_MEMORY_NAME);
-        log_file.close();
-        exit(EXIT_SUCCESS);
-    }
-}
-
-// Daemon function to initialize shared memory and log file
-void daemonize(const char* daemon_mode, const char* log_file_name, int poll_interval) {
-    if (strcmp(daemon_mode, "fileio") == 0) {
-        SHARED_MEMORY_NAME = "/shm_fileio";
-    } else if (strcmp(daemon_mode, "memmgmt") == 0){
-        SHARED_MEMORY_NAME = "/shm_memmgmt";
-    } else {
-        perror("daemon mod");
-        exit(EXIT_FAILURE);
-    }
-
-    shared_memory_fd = shm_open(SHARED_MEMORY_NAME, O_RDWR | O_CREAT, 0666);
-    handleError(shared_memory_fd == -1, "Failed to open shared memory");
-    bool is_newly_created = (errno == ENOENT);
-    handleError(ftruncate(shared_memory_fd, sizeof(SharedMemoryData)) == -1, "Failed to set size of shared memory");
-    shared_memory_data = static_cast<SharedMemoryData*>(mmap(nullptr, sizeof(SharedMemoryData), PROT_READ | PROT_WRITE, MAP_SHARED, shared_memory_fd, 0));
-    handleError(shared_memory_data == MAP_FAILED, "Failed to map shared memory");
-    log_file.open(log_file_name, std::ios::app);
-    handleError(!log_file.is_open(), "Failed to open log file");
-
-    if (is_newly_created) {
-        memset(shared_memory_data, 0, sizeof(SharedMemoryData));
-        shared_memory_data->offset = 0;
-    }
-
-    while (true) {
-        std::string data(shared_memory_data->buffer, strnlen(shared_memory_data->buffer, SHARED_MEMORY_SIZE - sizeof(int)));
-        if (!data.empty()) {
-            log_file << data;
-            //log_file << "\n";
-            log_file.flush();
-            memset(shared_memory_data->buffer, 0, SHARED_MEMORY_SIZE - sizeof(int));
-            shared_memory_data->offset = 0;
-        }
-        sleep(poll_interval);
-    }
-}
-
-int main(int argc, char* argv[]) {
-    signal(SIGINT, signalHandler);
-    if (argc != 4) {
-        std::cerr << "Usage: " << argv[0] << " <daemon_mode (fileio / memmgmt)> <log_file_name> <poll_interval>" << std::endl;
-        return EXIT_FAILURE;
-    }
-    daemonize(argv[1], argv[2], std::atoi(argv[3]));
-    return EXIT_SUCCESS;
+#include <iostream>
+#include <vector>
+#include <deque>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <unordered_map>
+#include <map>
+#include <memory>
+#include <functional>
+#include <tuple>
+#include <ctime>
+#include <climits>
+#include <cstring>
+#include <cstdarg>
+#include <cinttypes>
+#include <csignal>
+#include <cerrno>
+#include <getopt.h>
+#include <cpuid.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <linux/falloc.h>
+#include <unistd.h>
+#include <algorithm>
+
+#include "shared_memory.h"
+#include "event_record.h"
+#include "latency_histogram.h"
+#include "allocation_tracker.h"
+#include "columnar_log.h"
+#include "event_format.h"
+
+// Shared resources
+ChannelRegistry* channel_registry = nullptr;
+size_t registry_size = 0;
+const char* shared_memory_name = nullptr;
+int shared_memory_fd = -1;
+volatile sig_atomic_t running = 1;
+
+// Consumer state kept per ring
+struct RingState {
+    uint32_t expected_sequence;
+    uint64_t reported_dropped;
+};
+
+// Process identity, read once from the channel header
+struct ProcessInfo {
+    uint32_t pid;
+    std::string name;
+};
+
+// Executable mapping of a process, used to name call stack frames as module+offset
+struct ModuleMapping {
+    uint64_t start;
+    uint64_t end;
+    uint64_t offset;
+    std::string name;
+};
+
+// A process channel mapped by the daemon, indexed by its registry entry
+struct ProcessChannel {
+    SharedMemoryHeader* header;
+    size_t size;
+    ProcessInfo process;
+    bool closing;  // Drained one last time, then unmapped and its entry freed
+    std::vector<RingState> ring_states;
+    std::vector<uint64_t> drained_positions;
+    SummaryCounters<uint64_t> previous_summary;
+    uint64_t reported_uninterned_paths;
+
+    // Allocation tracking with -M; call sites are named while the process is alive
+    std::unique_ptr<AllocationTracker> allocations;
+    std::vector<std::string> call_site_names;
+    std::vector<ModuleMapping> modules;
+
+    // Paths announced by the process, indexed by path id, and their latency file ids with -F
+    std::vector<std::string> paths;
+    std::vector<uint32_t> path_latency_files;
+};
+std::vector<std::unique_ptr<ProcessChannel>> channels;
+uint32_t scanned_generation = 0;
+time_t liveness_checked_at = 0;
+uint64_t reported_rejected = 0;
+// PIDs of entries closed because their segment was invalid, freed once the process is gone
+std::vector<uint32_t> invalid_channel_pids;
+
+// Records collected from all rings in one drain cycle, rendered in timestamp order
+struct PendingEvent {
+    uint64_t timestamp;
+    const char* payload;
+    uint32_t payload_length;
+    uint32_t ring;
+    ProcessChannel* channel;
+};
+std::vector<PendingEvent> pending_events;
+
+enum SyncPolicy {
+    SYNC_NEVER,     // Leave write-back to the kernel
+    SYNC_BATCH,     // fdatasync after every batch written
+    SYNC_INTERVAL   // fdatasync at most every sync_interval seconds
+};
+
+// Command line configuration
+struct DaemonOptions {
+    uint32_t channel_count;
+    uint32_t ring_count;
+    uint32_t ring_size;
+    uint32_t clock_source;
+    uint32_t high_water_percent;
+    uint64_t preallocate_size;
+    uint64_t rotate_size;
+    uint32_t rotate_interval;
+    uint32_t sync_policy;
+    uint32_t sync_interval;
+    uint32_t summary_interval;
+    uint32_t latency_interval;
+    bool latency_per_file;
+    uint32_t allocation_interval;
+    bool render_events;
+    bool columnar;
+};
+
+// Log writer stage: the drain loop renders into large aligned buffers, a writer thread
+// submits them with writev and owns preallocation, rotation and syncing of the log file
+const size_t LOG_BUFFER_SIZE = 1 << 20;
+const size_t LOG_BUFFER_ALIGNMENT = 4096;
+const size_t INITIAL_LOG_BUFFERS = 4;
+const size_t MAX_LOG_BUFFERS = 64;
+const uint64_t DEFAULT_PREALLOCATE_SIZE = 64ull << 20;
+
+struct LogBuffer {
+    char* data;
+    size_t length;
+};
+
+struct LogWriter {
+    std::string file_name;
+    int fd;
+    uint64_t file_size;
+    uint64_t allocated_size;
+    time_t opened_at;
+    time_t synced_at;
+
+    std::mutex mutex;
+    std::condition_variable buffers_full;
+    std::condition_variable buffers_free;
+    std::deque<LogBuffer*> full_buffers;
+    std::vector<LogBuffer*> free_buffers;
+    size_t buffer_count;
+    bool stopping;
+    std::thread thread;
+
+    LogBuffer* current;  // Owned by the drain loop
+};
+LogWriter log_writer;
+DaemonOptions daemon_options;
+
+// With -C events are stored in <log_file_name>.clog as columnar blocks (columnar_log.h) by a
+// second writer; the text log keeps the reports and diagnostics. A block is flushed when it is
+// full or COLUMN_BLOCK_SECONDS after its first row, and reaches the writer as a single batch.
+const char* const COLUMN_LOG_SUFFIX = ".clog";
+const time_t COLUMN_BLOCK_SECONDS = 10;
+LogWriter column_writer;
+ColumnBlockEncoder column_block;
+time_t column_block_started_at = 0;
+
+const uint32_t TSC_CALIBRATION_MS = 50;
+
+// A cycle that drained at least this many records is treated as a burst and followed by another drain right away
+const size_t BURST_RECORDS = 1024;
+
+TimestampCache timestamp_cache = {-1, "", ""};
+
+// Aggregation mode summaries are snapshotted every summary_interval seconds; each snapshot
+// logs the growth since the previous one, so the log reads as a time series
+const uint32_t DEFAULT_SUMMARY_INTERVAL = 10;
+time_t summary_snapshot_at = 0;
+
+// Call latency histograms per process and operation, and per file with -F; reported and
+// reset every latency_interval seconds. File 0 stands for all calls of the operation.
+struct LatencyKey {
+    uint32_t pid;
+    uint32_t opcode;
+    uint32_t file;
+
+    bool operator<(const LatencyKey& other) const {
+        return std::tie(pid, opcode, file) < std::tie(other.pid, other.opcode, other.file);
+    }
+};
+
+struct LatencyStats {
+    std::string process_name;
+    LatencyHistogram histogram;
+};
+std::map<LatencyKey, LatencyStats> latency_stats;
+time_t latency_report_at = 0;
+
+// Live allocations are tracked per process with -M; every allocation_interval seconds the daemon
+// logs live and peak bytes, the live size classes and the call sites holding the most live bytes.
+// What is still live when a process exits is logged as its leaks.
+const uint32_t MAX_REPORTED_CALL_SITES = 10;
+time_t allocation_report_at = 0;
+
+// Paths of the files events referred to, shared by all processes; file 0 stands for none
+std::vector<std::string> latency_files = {""};
+std::unordered_map<std::string, uint32_t> latency_file_ids;
+
+// Error checking utility
+void handleError(bool condition, const char* error_message) {
+    if (condition) {
+        perror(error_message);
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Signal handler for SIGINT / SIGTERM, the main loop drains what is left and cleans up
+void signalHandler(int signal) {
+    if (signal == SIGINT || signal == SIGTERM) {
+        running = 0;
+        // Moving the doorbell makes a futex wait that is about to start return right away
+        if (channel_registry != nullptr) {
+            channel_registry->doorbell.fetch_add(1, std::memory_order_release);
+        }
+    }
+}
+
+// Without SA_RESTART the doorbell wait returns as soon as a signal arrives
+void installSignalHandlers() {
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = signalHandler;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+}
+
+LogBuffer* allocateLogBuffer() {
+    LogBuffer* buffer = new LogBuffer;
+    void* data = nullptr;
+    handleError(posix_memalign(&data, LOG_BUFFER_ALIGNMENT, LOG_BUFFER_SIZE) != 0, "Failed to allocate log buffer");
+    buffer->data = static_cast<char*>(data);
+    buffer->length = 0;
+    return buffer;
+}
+
+void openLogFile(LogWriter& writer) {
+    writer.fd = open(writer.file_name.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    handleError(writer.fd == -1, "Failed to open log file");
+    struct stat log_stat;
+    handleError(fstat(writer.fd, &log_stat) == -1, "Failed to stat log file");
+    writer.file_size = log_stat.st_size;
+    writer.allocated_size = log_stat.st_size;
+    writer.opened_at = time(nullptr);
+    writer.synced_at = writer.opened_at;
+}
+
+// Truncating to the written size releases the preallocated blocks past the end of the file
+void closeLogFile(LogWriter& writer) {
+    if (writer.allocated_size > writer.file_size) {
+        ftruncate(writer.fd, writer.file_size);
+    }
+    close(writer.fd);
+    writer.fd = -1;
+}
+
+// Move the current file aside as <name>.<YYYYmmdd-HHMMSS> and start a new one
+void rotateLogFile(LogWriter& writer) {
+    closeLogFile(writer);
+    char suffix[32];
+    time_t now = time(nullptr);
+    struct tm time_info;
+    localtime_r(&now, &time_info);
+    strftime(suffix, sizeof(suffix), ".%Y%m%d-%H%M%S", &time_info);
+    std::string rotated_name = writer.file_name + suffix;
+    for (int attempt = 1; access(rotated_name.c_str(), F_OK) == 0; ++attempt) {
+        rotated_name = writer.file_name + suffix + "." + std::to_string(attempt);
+    }
+    handleError(rename(writer.file_name.c_str(), rotated_name.c_str()) == -1, "Failed to rotate log file");
+    openLogFile(writer);
+}
+
+// Reserve disk space in large segments ahead of the writes, without changing the file size
+void preallocateLogFile(LogWriter& writer, uint64_t incoming) {
+    uint64_t segment = daemon_options.preallocate_size;
+    if (segment == 0 || writer.file_size + incoming <= writer.allocated_size) {
+        return;
+    }
+    uint64_t length = ((writer.file_size + incoming - writer.allocated_size) / segment + 1) * segment;
+    if (fallocate(writer.fd, FALLOC_FL_KEEP_SIZE, writer.allocated_size, length) == 0) {
+        writer.allocated_size += length;
+    } else {
+        // Not supported by the file system, write without preallocation
+        daemon_options.preallocate_size = 0;
+    }
+}
+
+void writeLogBuffers(LogWriter& writer, std::vector<LogBuffer*>& batch) {
+    uint64_t incoming = 0;
+    for (LogBuffer* buffer : batch) {
+        incoming += buffer->length;
+    }
+    time_t now = time(nullptr);
+    if ((daemon_options.rotate_size != 0 && writer.file_size != 0 &&
+         writer.file_size + incoming > daemon_options.rotate_size) ||
+        (daemon_options.rotate_interval != 0 && now - writer.opened_at >= daemon_options.rotate_interval)) {
+        rotateLogFile(writer);
+    }
+    preallocateLogFile(writer, incoming);
+
+    size_t index = 0;
+    size_t offset = 0;
+    while (index < batch.size()) {
+        struct iovec vectors[IOV_MAX];
+        int vector_count = 0;
+        for (size_t next = index; next < batch.size() && vector_count < IOV_MAX; ++next) {
+            size_t skip = next == index ? offset : 0;
+            vectors[vector_count].iov_base = batch[next]->data + skip;
+            vectors[vector_count].iov_len = batch[next]->length - skip;
+            ++vector_count;
+        }
+        ssize_t written = writev(writer.fd, vectors, vector_count);
+        if (written == -1 && errno == EINTR) {
+            continue;
+        }
+        handleError(written == -1, "Failed to write log file");
+        writer.file_size += written;
+        // Advance past fully written buffers, a short write resumes inside the current one
+        size_t remaining = static_cast<size_t>(written);
+        while (index < batch.size() && remaining >= batch[index]->length - offset) {
+            remaining -= batch[index]->length - offset;
+            offset = 0;
+            ++index;
+        }
+        offset += remaining;
+    }
+
+    if (daemon_options.sync_policy == SYNC_BATCH ||
+        (daemon_options.sync_policy == SYNC_INTERVAL && now - writer.synced_at >= daemon_options.sync_interval)) {
+        fdatasync(writer.fd);
+        writer.synced_at = now;
+    }
+}
+
+void logWriterMain(LogWriter& writer) {
+    std::vector<LogBuffer*> batch;
+    std::unique_lock<std::mutex> lock(writer.mutex);
+    while (true) {
+        writer.buffers_full.wait(lock, [&writer] { return writer.stopping || !writer.full_buffers.empty(); });
+        if (writer.full_buffers.empty()) {
+            break;
+        }
+        batch.assign(writer.full_buffers.begin(), writer.full_buffers.end());
+        writer.full_buffers.clear();
+        lock.unlock();
+        writeLogBuffers(writer, batch);
+        lock.lock();
+        for (LogBuffer* buffer : batch) {
+            buffer->length = 0;
+            writer.free_buffers.push_back(buffer);
+        }
+        writer.buffers_free.notify_one();
+    }
+}
+
+void startLogWriter(LogWriter& writer, const std::string& file_name) {
+    writer.file_name = file_name;
+    openLogFile(writer);
+    for (size_t count = 0; count < INITIAL_LOG_BUFFERS; ++count) {
+        writer.free_buffers.push_back(allocateLogBuffer());
+    }
+    writer.buffer_count = INITIAL_LOG_BUFFERS;
+    writer.stopping = false;
+    writer.current = nullptr;
+    writer.thread = std::thread(logWriterMain, std::ref(writer));
+}
+
+// Hand the buffer being filled to the writer thread
+void submitLogBuffer(LogWriter& writer) {
+    if (writer.current == nullptr || writer.current->length == 0) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(writer.mutex);
+    writer.full_buffers.push_back(writer.current);
+    writer.current = nullptr;
+    writer.buffers_full.notify_one();
+}
+
+// The pool grows while the writer falls behind and only applies back-pressure at MAX_LOG_BUFFERS
+LogBuffer* acquireLogBuffer(LogWriter& writer) {
+    std::unique_lock<std::mutex> lock(writer.mutex);
+    if (writer.free_buffers.empty() && writer.buffer_count < MAX_LOG_BUFFERS) {
+        ++writer.buffer_count;
+        return allocateLogBuffer();
+    }
+    writer.buffers_free.wait(lock, [&writer] { return !writer.free_buffers.empty(); });
+    LogBuffer* buffer = writer.free_buffers.back();
+    writer.free_buffers.pop_back();
+    return buffer;
+}
+
+// Hand several filled buffers to the writer thread at once, so they land in the same batch and file
+void submitLogBuffers(LogWriter& writer, std::vector<LogBuffer*>& buffers) {
+    std::lock_guard<std::mutex> lock(writer.mutex);
+    writer.full_buffers.insert(writer.full_buffers.end(), buffers.begin(), buffers.end());
+    buffers.clear();
+    writer.buffers_full.notify_one();
+}
+
+// Space for up to max_length bytes of output, completed by commitLog()
+char* reserveLog(size_t max_length) {
+    if (log_writer.current != nullptr && LOG_BUFFER_SIZE - log_writer.current->length < max_length) {
+        submitLogBuffer(log_writer);
+    }
+    if (log_writer.current == nullptr) {
+        log_writer.current = acquireLogBuffer(log_writer);
+    }
+    return log_writer.current->data + log_writer.current->length;
+}
+
+void commitLog(size_t length) {
+    log_writer.current->length += length;
+}
+
+void appendLogLine(const char* format, ...) {
+    char* line = reserveLog(MAX_LINE_LENGTH);
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(line, MAX_LINE_LENGTH, format, args);
+    va_end(args);
+    commitLog(std::min(static_cast<size_t>(length), MAX_LINE_LENGTH - 1));
+}
+
+// Copy bytes into log buffers taken from the writer's pool, filling the last one first
+void appendLogBytes(LogWriter& writer, std::vector<LogBuffer*>& buffers, const void* data, size_t length) {
+    const char* bytes = static_cast<const char*>(data);
+    while (length != 0) {
+        if (buffers.empty() || buffers.back()->length == LOG_BUFFER_SIZE) {
+            buffers.push_back(acquireLogBuffer(writer));
+        }
+        LogBuffer* buffer = buffers.back();
+        size_t chunk = std::min(length, LOG_BUFFER_SIZE - buffer->length);
+        memcpy(buffer->data + buffer->length, bytes, chunk);
+        buffer->length += chunk;
+        bytes += chunk;
+        length -= chunk;
+    }
+}
+
+void flushColumnBlock() {
+    if (column_block.header.row_count == 0) {
+        return;
+    }
+    column_block.finish(channel_registry->clock_anchor);
+    std::vector<LogBuffer*> buffers;
+    appendLogBytes(column_writer, buffers, &column_block.header, sizeof(column_block.header));
+    for (const std::vector<uint8_t>& column : column_block.columns) {
+        appendLogBytes(column_writer, buffers, column.data(), column.size());
+    }
+    submitLogBuffers(column_writer, buffers);
+    column_block.reset();
+}
+
+void stopLogWriter(LogWriter& writer) {
+    submitLogBuffer(writer);
+    {
+        std::lock_guard<std::mutex> lock(writer.mutex);
+        writer.stopping = true;
+        writer.buffers_full.notify_one();
+    }
+    writer.thread.join();
+    closeLogFile(writer);
+}
+
+// Invariant TSC ticks at a constant rate across cores and power states
+bool isInvariantTscAvailable() {
+    unsigned int eax, ebx, ecx, edx;
+    if (!isTscAvailable() || __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) == 0) {
+        return false;
+    }
+    return (edx & (1u << 8)) != 0;
+}
+
+// Pair a raw clock reading with the wall clock and measure the raw tick rate
+ClockAnchor calibrateClock(uint32_t clock_source) {
+    RawClockReader read_raw_clock = rawClockReader(clock_source);
+    ClockAnchor anchor;
+    anchor.ticks_per_second = 1000000000ull;
+    if (clock_source == CLOCK_SOURCE_TSC) {
+        uint64_t monotonic_start = readMonotonicClock();
+        uint64_t tsc_start = read_raw_clock();
+        struct timespec calibration = {0, TSC_CALIBRATION_MS * 1000000l};
+        nanosleep(&calibration, nullptr);
+        uint64_t monotonic_end = readMonotonicClock();
+        uint64_t tsc_end = read_raw_clock();
+        anchor.ticks_per_second = static_cast<uint64_t>(static_cast<unsigned __int128>(tsc_end - tsc_start) *
+                                                        1000000000ull / (monotonic_end - monotonic_start));
+    }
+
+    // Bracket the wall clock read between two raw reads and take the midpoint
+    struct timespec realtime;
+    uint64_t raw_before = read_raw_clock();
+    clock_gettime(CLOCK_REALTIME, &realtime);
+    uint64_t raw_after = read_raw_clock();
+    anchor.raw = raw_before + (raw_after - raw_before) / 2;
+    anchor.realtime_ns = timespecToNanoseconds(realtime);
+    return anchor;
+}
+
+// Create the channel registry; processes lay out their own channels with its ring geometry
+void initializeSharedMemory(const DaemonOptions& options) {
+    shared_memory_fd = shm_open(shared_memory_name, O_RDWR | O_CREAT, 0666);
+    handleError(shared_memory_fd == -1, "Failed to open shared memory");
+    registry_size = registrySize(options.channel_count);
+    handleError(ftruncate(shared_memory_fd, 0) == -1 || ftruncate(shared_memory_fd, registry_size) == -1,
+                "Failed to set size of shared memory");
+    void* mapping = mmap(nullptr, registry_size, PROT_READ | PROT_WRITE, MAP_SHARED, shared_memory_fd, 0);
+    handleError(mapping == MAP_FAILED, "Failed to map shared memory");
+
+    channel_registry = static_cast<ChannelRegistry*>(mapping);
+    channel_registry->version = SHARED_MEMORY_VERSION;
+    channel_registry->channel_count = options.channel_count;
+    channel_registry->ring_count = options.ring_count;
+    channel_registry->ring_size = options.ring_size;
+    channel_registry->clock_source = options.clock_source;
+    channel_registry->high_water_mark = static_cast<uint32_t>(static_cast<uint64_t>(options.ring_size) *
+                                                              options.high_water_percent / 100);
+    channel_registry->clock_anchor = calibrateClock(options.clock_source);
+    channel_registry->magic.store(SHARED_MEMORY_MAGIC, std::memory_order_release);
+    channels.resize(options.channel_count);
+    invalid_channel_pids.resize(options.channel_count, 0);
+}
+
+void unlinkChannelSegment(uint32_t index, uint32_t pid) {
+    char segment_name[CHANNEL_NAME_SIZE];
+    channelSegmentName(segment_name, sizeof(segment_name), shared_memory_name, pid, index);
+    shm_unlink(segment_name);
+}
+
+bool isPowerOfTwo(uint32_t value) {
+    return value != 0 && (value & (value - 1)) == 0;
+}
+
+// Mark an entry whose segment cannot be drained CLOSED. A process that still runs keeps it,
+// so nobody else claims it in the meantime; it is freed once the process is gone.
+void rejectChannel(uint32_t index, uint32_t pid, bool closing) {
+    ChannelEntry* entry = channelEntry(channel_registry, index);
+    if (closing) {
+        entry->pid.store(0, std::memory_order_relaxed);
+        entry->state.store(CHANNEL_FREE, std::memory_order_release);
+        return;
+    }
+    entry->state.store(CHANNEL_CLOSED, std::memory_order_release);
+    invalid_channel_pids[index] = pid;
+}
+
+// Map the channel a process activated. The name is unlinked right away, so the segment
+// goes away with the last mapping even when the process and the daemon die. A process that
+// closed its channel or died before the daemon saw it may have left no complete segment,
+// its entry is then freed without a complaint. The ring geometry comes from the process, it
+// is checked against the mapping before any ring is read.
+void attachChannel(uint32_t index, uint32_t pid, bool closing) {
+    char segment_name[CHANNEL_NAME_SIZE];
+    channelSegmentName(segment_name, sizeof(segment_name), shared_memory_name, pid, index);
+    int segment_fd = shm_open(segment_name, O_RDWR, 0666);
+    void* mapping = MAP_FAILED;
+    size_t size = 0;
+    struct stat segment_stat;
+    if (segment_fd != -1 && fstat(segment_fd, &segment_stat) == 0 &&
+        static_cast<size_t>(segment_stat.st_size) >= sizeof(SharedMemoryHeader)) {
+        size = segment_stat.st_size;
+        mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, segment_fd, 0);
+    }
+    if (segment_fd != -1) {
+        close(segment_fd);
+        shm_unlink(segment_name);
+    }
+    SharedMemoryHeader* header = static_cast<SharedMemoryHeader*>(mapping);
+    bool published = mapping != MAP_FAILED && header->magic.load(std::memory_order_acquire) == SHARED_MEMORY_MAGIC;
+    if (!published || header->version != SHARED_MEMORY_VERSION || header->pid != pid || header->ring_count < 2 ||
+        header->ring_count > MAX_RING_COUNT || !isPowerOfTwo(header->ring_size) || header->ring_size < MIN_RING_SIZE ||
+        header->ring_size > MAX_RING_SIZE || sharedMemorySize(header->ring_count, header->ring_size) > size) {
+        if (published || !closing) {
+            appendLogLine("[LibCLog] PID=%u, channel=%u, invalid channel shared memory\n", pid, index);
+        }
+        if (mapping != MAP_FAILED) {
+            munmap(mapping, size);
+        }
+        rejectChannel(index, pid, closing);
+        return;
+    }
+
+    std::unique_ptr<ProcessChannel> channel(new ProcessChannel);
+    channel->header = header;
+    channel->size = size;
+    channel->process.pid = pid;
+    channel->process.name.assign(header->process_name, strnlen(header->process_name, sizeof(header->process_name)));
+    channel->closing = closing;
+    channel->ring_states.assign(header->ring_count, RingState{0, 0});
+    channel->drained_positions.assign(header->ring_count, 0);
+    memset(&channel->previous_summary, 0, sizeof(channel->previous_summary));
+    channel->reported_uninterned_paths = 0;
+    if (daemon_options.allocation_interval != 0) {
+        channel->allocations.reset(new AllocationTracker(header->frees_complete != 0));
+        channel->call_site_names.push_back("");
+    }
+    channels[index] = std::move(channel);
+}
+
+bool isProcessDead(uint32_t pid) {
+    return pid != 0 && kill(static_cast<pid_t>(pid), 0) == -1 && errno == ESRCH;
+}
+
+// Attach channels activated since the last scan and mark closed ones and those of dead
+// processes for a final drain. Channels that closed, or whose process died, before a scan saw
+// them active are attached too, so their events and summary still get out before the entry is freed.
+void refreshChannels() {
+    time_t now = time(nullptr);
+    uint32_t generation = channel_registry->generation.load(std::memory_order_acquire);
+    bool check_liveness = now != liveness_checked_at;
+    if (generation == scanned_generation && !check_liveness) {
+        return;
+    }
+    scanned_generation = generation;
+    if (check_liveness) {
+        liveness_checked_at = now;
+    }
+    for (uint32_t index = 0; index < channel_registry->channel_count; ++index) {
+        ChannelEntry* entry = channelEntry(channel_registry, index);
+        uint32_t state = entry->state.load(std::memory_order_acquire);
+        uint32_t pid = entry->pid.load(std::memory_order_relaxed);
+        std::unique_ptr<ProcessChannel>& channel = channels[index];
+        if (invalid_channel_pids[index] != 0) {
+            bool rejected = state == CHANNEL_CLOSED && pid == invalid_channel_pids[index];
+            if (rejected && (!check_liveness || !isProcessDead(pid))) {
+                continue;
+            }
+            invalid_channel_pids[index] = 0;
+            if (rejected) {
+                entry->pid.store(0, std::memory_order_relaxed);
+                entry->state.store(CHANNEL_FREE, std::memory_order_release);
+                continue;
+            }
+        }
+        if (channel == nullptr) {
+            bool closed = state == CHANNEL_CLOSED || (state == CHANNEL_CLAIMED && check_liveness && isProcessDead(pid));
+            if (state == CHANNEL_ACTIVE || closed) {
+                attachChannel(index, pid, closed);
+            }
+        }
+        if (channel != nullptr) {
+            channel->closing = channel->closing || state == CHANNEL_CLOSED ||
+                               (check_liveness && isProcessDead(channel->process.pid));
+        }
+    }
+
+    uint64_t rejected = channel_registry->rejected.load(std::memory_order_relaxed);
+    if (rejected != reported_rejected) {
+        appendLogLine("[LibCLog] registry full, rejected_processes=%" PRIu64 ", total_rejected=%" PRIu64 "\n",
+                      rejected - reported_rejected, rejected);
+        reported_rejected = rejected;
+    }
+}
+
+// Report records the producers could not fit into a ring
+void reportDroppedRecords(ProcessChannel& channel, uint32_t index, RingSlot* slot) {
+    uint64_t dropped = slot->dropped.load(std::memory_order_relaxed);
+    RingState& state = channel.ring_states[index];
+    if (dropped != state.reported_dropped) {
+        appendLogLine("[LibCLog] PID=%u, ring=%u, dropped=%" PRIu64 ", total_dropped=%" PRIu64 "\n",
+                      channel.process.pid, index, dropped - state.reported_dropped, dropped);
+        state.reported_dropped = dropped;
+    }
+}
+
+// Report paths the process could not intern because its path table was full; their events carry no path
+void reportUninternedPaths(ProcessChannel& channel) {
+    uint64_t uninterned = channel.header->uninterned_paths.load(std::memory_order_relaxed);
+    if (uninterned != channel.reported_uninterned_paths) {
+        appendLogLine("[LibCLog] PID=%u, uninterned_paths=%" PRIu64 ", total_uninterned_paths=%" PRIu64 "\n",
+                      channel.process.pid, uninterned - channel.reported_uninterned_paths, uninterned);
+        channel.reported_uninterned_paths = uninterned;
+    }
+}
+
+// Render a raw event timestamp as "YYYY-MM-DD hh:mm:ss.mmm" in local time
+const char* formatTimestamp(uint64_t raw_timestamp) {
+    return formatTimestamp(timestamp_cache, channel_registry->clock_anchor, raw_timestamp);
+}
+
+// Latency file of the path an event carries, interned once per process and path id
+uint32_t latencyFile(const EventRecord* event, ProcessChannel& channel) {
+    if (event->file >= channel.paths.size() || channel.paths[event->file].empty()) {
+        return 0;
+    }
+    if (event->file >= channel.path_latency_files.size()) {
+        channel.path_latency_files.resize(channel.paths.size(), 0);
+    }
+    uint32_t& file = channel.path_latency_files[event->file];
+    if (file == 0) {
+        const std::string& path = channel.paths[event->file];
+        auto interned = latency_file_ids.emplace(path, static_cast<uint32_t>(latency_files.size()));
+        if (interned.second) {
+            latency_files.push_back(path);
+        }
+        file = interned.first->second;
+    }
+    return file;
+}
+
+void recordLatency(const LatencyKey& key, const ProcessInfo& process, uint64_t nanoseconds) {
+    auto stats = latency_stats.find(key);
+    if (stats == latency_stats.end()) {
+        stats = latency_stats.emplace(key, LatencyStats{process.name, LatencyHistogram()}).first;
+    }
+    stats->second.histogram.record(nanoseconds);
+}
+
+void recordEventLatency(const EventRecord* event, ProcessChannel& channel) {
+    if (event->opcode == OP_SAMPLING) {
+        return;
+    }
+    const ProcessInfo& process = channel.process;
+    uint64_t nanoseconds = rawClockToNanoseconds(channel_registry->clock_anchor, event->duration);
+    recordLatency(LatencyKey{process.pid, event->opcode, 0}, process, nanoseconds);
+    uint32_t file = daemon_options.latency_per_file && event->file != NO_PATH ? latencyFile(event, channel) : 0;
+    if (file != 0) {
+        recordLatency(LatencyKey{process.pid, event->opcode, file}, process, nanoseconds);
+    }
+}
+
+void loadModuleMappings(ProcessChannel& channel) {
+    channel.modules.clear();
+    std::string maps_path = "/proc/" + std::to_string(channel.process.pid) + "/maps";
+    FILE* maps = fopen(maps_path.c_str(), "r");
+    if (maps == nullptr) {
+        return;
+    }
+    char line[PATH_MAX + 256];
+    while (fgets(line, sizeof(line), maps) != nullptr) {
+        unsigned long long start, end, offset;
+        char permissions[8];
+        int path_start = 0;
+        if (sscanf(line, "%llx-%llx %7s %llx %*s %*s %n", &start, &end, permissions, &offset, &path_start) == 4 &&
+            permissions[2] == 'x' && path_start != 0 && line[path_start] != '\0' && line[path_start] != '\n') {
+            std::string path(line + path_start, strcspn(line + path_start, "\n"));
+            channel.modules.push_back(ModuleMapping{start, end, offset, path.substr(path.rfind('/') + 1)});
+        }
+    }
+    fclose(maps);
+}
+
+// "module+0xoffset" for frames inside a mapped file, the raw address otherwise
+std::string describeFrame(ProcessChannel& channel, uint64_t frame, bool& reloaded) {
+    while (true) {
+        for (const ModuleMapping& module : channel.modules) {
+            if (frame >= module.start && frame < module.end) {
+                char text[PATH_MAX + 32];
+                snprintf(text, sizeof(text), "%s+0x%" PRIx64, module.name.c_str(), frame - module.start + module.offset);
+                return text;
+            }
+        }
+        if (reloaded) {
+            break;
+        }
+        // Libraries loaded since the last read are picked up once per call site
+        loadModuleMappings(channel);
+        reloaded = true;
+    }
+    char text[32];
+    snprintf(text, sizeof(text), "0x%" PRIx64, frame);
+    return text;
+}
+
+void describeNewCallSites(ProcessChannel& channel) {
+    const std::vector<CallSite>& call_sites = channel.allocations->call_sites;
+    while (channel.call_site_names.size() < call_sites.size()) {
+        const CallSite& site = call_sites[channel.call_site_names.size()];
+        bool reloaded = false;
+        std::string name;
+        for (uint32_t index = 0; index < site.depth; ++index) {
+            name += (index != 0 ? ";" : "") + describeFrame(channel, site.frames[index], reloaded);
+        }
+        channel.call_site_names.push_back(name);
+    }
+}
+
+// Queue an allocator event for the process's live-allocation table. The duration is measured after
+// the libc call returned, so start plus duration orders an allocation after the free that let the
+// allocator hand its address out again.
+void trackAllocation(const EventRecord* event, ProcessChannel& channel) {
+    AllocationTracker& tracker = *channel.allocations;
+    uint64_t frames[MAX_CALL_STACK_DEPTH];
+    uint32_t depth = std::min<uint32_t>(event->string_length / sizeof(uint64_t), MAX_CALL_STACK_DEPTH);
+    memcpy(frames, eventString(event), depth * sizeof(uint64_t));
+    uint64_t pointer = static_cast<uint64_t>(event->result);
+    uint64_t returned = event->timestamp + event->duration;
+    switch (event->opcode) {
+        case OP_MALLOC:
+        case OP_VALLOC:
+            tracker.queueAllocation(pointer, eventArgument(event, 0), frames, depth, returned, event->timestamp);
+            break;
+        case OP_CALLOC:
+            tracker.queueAllocation(pointer, eventArgument(event, 0) * eventArgument(event, 1), frames, depth, returned,
+                                    event->timestamp);
+            break;
+        case OP_POSIX_MEMALIGN:
+        case OP_ALIGNED_ALLOC:
+        case OP_MEMALIGN:
+            tracker.queueAllocation(pointer, eventArgument(event, 1), frames, depth, returned, event->timestamp);
+            break;
+        case OP_REALLOC:
+            // A failed realloc keeps the old block, realloc(pointer, 0) frees it
+            if (pointer != 0 || eventArgument(event, 1) == 0) {
+                tracker.queueFree(eventArgument(event, 0), event->timestamp);
+            }
+            tracker.queueAllocation(pointer, eventArgument(event, 1), frames, depth, returned, event->timestamp);
+            break;
+        case OP_FREE:
+            tracker.queueFree(eventArgument(event, 0), event->timestamp);
+            break;
+        default:
+            return;
+    }
+    if (tracker.call_sites.size() != channel.call_site_names.size()) {
+        describeNewCallSites(channel);
+    }
+}
+
+// Decode one ring record, returns false when the payload is not a valid event
+bool handleEvent(const char* payload, uint32_t payload_length, ProcessChannel& channel) {
+    const EventRecord* event = reinterpret_cast<const EventRecord*>(payload);
+    if (payload_length < sizeof(EventRecord) || event->argument_count > MAX_EVENT_ARGUMENTS ||
+        eventLength(event->argument_count, event->string_length) > payload_length) {
+        return false;
+    }
+    if (event->opcode == OP_PATH) {
+        uint64_t path = eventArgument(event, 0);
+        if (path == NO_PATH || path >= PATH_TABLE_SIZE) {
+            return false;
+        }
+        if (path >= channel.paths.size()) {
+            channel.paths.resize(path + 1);
+        }
+        channel.paths[path].assign(eventString(event), event->string_length);
+        return true;
+    }
+    const std::string* path = event->file != NO_PATH && event->file < channel.paths.size() ? &channel.paths[event->file] : nullptr;
+    if (daemon_options.columnar) {
+        if (column_block.header.row_count == 0) {
+            column_block_started_at = time(nullptr);
+        }
+        column_block.append(event, channel.process.pid, channel.process.name, path);
+        if (column_block.isFull()) {
+            flushColumnBlock();
+        }
+    } else if (daemon_options.render_events) {
+        char* line = reserveLog(MAX_LINE_LENGTH);
+        commitLog(formatEvent(event, channel.process.pid, channel.process.name.c_str(),
+                              path != nullptr ? path->data() : nullptr, path != nullptr ? path->size() : 0,
+                              channel_registry->clock_anchor, timestamp_cache, line, MAX_LINE_LENGTH));
+    }
+    if (daemon_options.latency_interval != 0) {
+        recordEventLatency(event, channel);
+    }
+    if (channel.allocations != nullptr) {
+        trackAllocation(event, channel);
+    }
+    return true;
+}
+
+// Queue every published record of a ring; its space is handed back once the cycle is rendered
+void collectRing(ProcessChannel& channel, uint32_t index) {
+    SharedMemoryHeader* header = channel.header;
+    RingSlot* slot = ringSlot(header, index);
+    const char* buffer = ringBuffer(header, index);
+    uint32_t ring_size = header->ring_size;
+    RingState& state = channel.ring_states[index];
+    uint64_t tail = slot->tail.load(std::memory_order_relaxed);
+    uint64_t head = slot->head.load(std::memory_order_acquire);
+
+    while (tail < head) {
+        const RecordHeader* record = reinterpret_cast<const RecordHeader*>(buffer + (tail & (ring_size - 1)));
+        uint32_t length = record->length & ~RECORD_PADDING_FLAG;
+        if (length < sizeof(RecordHeader) || length > head - tail) {
+            appendLogLine("[LibCLog] PID=%u, ring=%u, corrupted record at position=%" PRIu64 "\n",
+                          channel.process.pid, index, tail);
+            tail = head;
+            break;
+        }
+        if ((record->length & RECORD_PADDING_FLAG) == 0) {
+            if (record->sequence != state.expected_sequence) {
+                appendLogLine("[LibCLog] PID=%u, ring=%u, sequence gap: expected=%u, received=%u\n",
+                              channel.process.pid, index, state.expected_sequence, record->sequence);
+            }
+            state.expected_sequence = record->sequence + 1;
+            const char* payload = reinterpret_cast<const char*>(record + 1);
+            uint32_t payload_length = length - sizeof(RecordHeader);
+            uint64_t timestamp = payload_length >= sizeof(EventRecord)
+                                     ? reinterpret_cast<const EventRecord*>(payload)->timestamp : 0;
+            pending_events.push_back(PendingEvent{timestamp, payload, payload_length, index, &channel});
+        }
+        tail += length;
+    }
+    channel.drained_positions[index] = tail;
+}
+
+// Drain the rings of every channel, render their events in timestamp order and release the ring space.
+// Each channel is drained up to what its own rings hold, so a flooding process only drops its own records.
+size_t drainRings() {
+    pending_events.clear();
+    // Read before any ring, records published later are ordered no earlier than this
+    uint64_t drain_started = rawClockReader(channel_registry->clock_source)();
+    for (const std::unique_ptr<ProcessChannel>& channel : channels) {
+        if (channel != nullptr) {
+            for (uint32_t index = 0; index < channel->header->ring_count; ++index) {
+                collectRing(*channel, index);
+            }
+        }
+    }
+
+    // Each ring is already ordered, the stable sort interleaves rings without reordering a thread's events
+    std::stable_sort(pending_events.begin(), pending_events.end(),
+                     [](const PendingEvent& left, const PendingEvent& right) { return left.timestamp < right.timestamp; });
+    for (const PendingEvent& pending : pending_events) {
+        if (!handleEvent(pending.payload, pending.payload_length, *pending.channel)) {
+            appendLogLine("[LibCLog] PID=%u, ring=%u, malformed event\n", pending.channel->process.pid, pending.ring);
+        }
+    }
+
+    for (const std::unique_ptr<ProcessChannel>& channel : channels) {
+        if (channel != nullptr && channel->allocations != nullptr) {
+            // Nothing more arrives from a channel drained for the last time
+            channel->allocations->applyBatch(channel->closing ? UINT64_MAX : drain_started);
+        }
+    }
+
+    for (const std::unique_ptr<ProcessChannel>& channel : channels) {
+        if (channel != nullptr) {
+            for (uint32_t index = 0; index < channel->header->ring_count; ++index) {
+                RingSlot* slot = ringSlot(channel->header, index);
+                slot->tail.store(channel->drained_positions[index], std::memory_order_release);
+                reportDroppedRecords(*channel, index, slot);
+            }
+            reportUninternedPaths(*channel);
+        }
+    }
+    return pending_events.size();
+}
+
+// Append " name=bucket:count,..." for the non-empty buckets of a histogram delta
+int formatHistogram(char* output, size_t size, const char* name, const uint64_t* current, const uint64_t* previous,
+                    uint32_t bucket_count, bool growth) {
+    int length = snprintf(output, size, ", %s=", name);
+    const char* separator = "";
+    for (uint32_t bucket = 0; bucket < bucket_count && static_cast<size_t>(length) < size; ++bucket) {
+        if (current[bucket] != previous[bucket]) {
+            if (growth) {
+                length += snprintf(output + length, size - length, "%s%+d:%" PRIu64, separator,
+                                   static_cast<int>(bucket) - REALLOC_GROWTH_LIMIT, current[bucket] - previous[bucket]);
+            } else {
+                length += snprintf(output + length, size - length, "%s%" PRIu64 ":%" PRIu64, separator,
+                                   sizeBucketLowerBound(bucket), current[bucket] - previous[bucket]);
+            }
+            separator = ",";
+        }
+    }
+    return std::min(length, static_cast<int>(size) - 1);
+}
+
+// Log what a process summary gained since the previous snapshot
+void logSummaryDelta(const ProcessInfo& process, const SummaryCounters<uint64_t>& current,
+                     const SummaryCounters<uint64_t>& previous, const char* timestamp) {
+    for (uint32_t opcode = 0; opcode < OP_COUNT; ++opcode) {
+        if (current.calls[opcode] == previous.calls[opcode]) {
+            continue;
+        }
+        char* line = reserveLog(MAX_LINE_LENGTH);
+        int length = snprintf(line, MAX_LINE_LENGTH, "[%s] PID=%u, process=%s, summary: operation=%s, calls=%" PRIu64
+                              ", bytes=%" PRIu64, timestamp, process.pid, process.name.c_str(), eventOpcodeName(opcode),
+                              current.calls[opcode] - previous.calls[opcode], current.bytes[opcode] - previous.bytes[opcode]);
+        if (current.bytes[opcode] != previous.bytes[opcode]) {
+            length += formatHistogram(line + length, MAX_LINE_LENGTH - length - 1, "sizes", current.size_histogram[opcode],
+                                      previous.size_histogram[opcode], SIZE_HISTOGRAM_BUCKETS, false);
+        }
+        line[length++] = '\n';
+        commitLog(length);
+    }
+    for (uint32_t fd = 0; fd < SUMMARY_FD_COUNT; ++fd) {
+        if (current.fd_bytes_read[fd] != previous.fd_bytes_read[fd] ||
+            current.fd_bytes_written[fd] != previous.fd_bytes_written[fd]) {
+            appendLogLine("[%s] PID=%u, process=%s, summary: file_descriptor=%u%s, bytes_read=%" PRIu64
+                          ", bytes_written=%" PRIu64 "\n", timestamp, process.pid, process.name.c_str(), fd,
+                          fd == SUMMARY_FD_COUNT - 1 ? "+" : "", current.fd_bytes_read[fd] - previous.fd_bytes_read[fd],
+                          current.fd_bytes_written[fd] - previous.fd_bytes_written[fd]);
+        }
+    }
+    if (memcmp(current.realloc_growth, previous.realloc_growth, sizeof(current.realloc_growth)) != 0) {
+        char* line = reserveLog(MAX_LINE_LENGTH);
+        int length = snprintf(line, MAX_LINE_LENGTH, "[%s] PID=%u, process=%s, summary: realloc", timestamp,
+                              process.pid, process.name.c_str());
+        length += formatHistogram(line + length, MAX_LINE_LENGTH - length - 1, "log2_growth", current.realloc_growth,
+                                  previous.realloc_growth, REALLOC_GROWTH_BUCKETS, true);
+        line[length++] = '\n';
+        commitLog(length);
+    }
+}
+
+// Log what the summary of a channel's process gained since the previous snapshot
+void snapshotSummary(ProcessChannel& channel, const char* timestamp) {
+    ProcessSummary* summary = processSummary(channel.header);
+    if (summary->published.load(std::memory_order_acquire) == 0) {
+        return;
+    }
+    SummaryCounters<uint64_t> current;
+    const std::atomic<uint64_t>* source = reinterpret_cast<const std::atomic<uint64_t>*>(&summary->counters);
+    uint64_t* target = reinterpret_cast<uint64_t*>(&current);
+    for (size_t counter = 0; counter < sizeof(current) / sizeof(uint64_t); ++counter) {
+        target[counter] = source[counter].load(std::memory_order_relaxed);
+    }
+    logSummaryDelta(channel.process, current, channel.previous_summary, timestamp);
+    channel.previous_summary = current;
+}
+
+void snapshotSummaries() {
+    const char* timestamp = formatTimestamp(rawClockReader(channel_registry->clock_source)());
+    for (const std::unique_ptr<ProcessChannel>& channel : channels) {
+        if (channel != nullptr) {
+            snapshotSummary(*channel, timestamp);
+        }
+    }
+}
+
+// Log live and peak usage of a process and the call sites holding the most live bytes.
+// kind names the process line and site_kind the call site lines.
+void reportAllocations(ProcessChannel& channel, const char* kind, const char* site_kind) {
+    static const uint64_t EMPTY_HISTOGRAM[SIZE_HISTOGRAM_BUCKETS] = {};
+    AllocationTracker& tracker = *channel.allocations;
+    char peak_at[48] = "-";
+    if (tracker.peak_timestamp != 0) {
+        snprintf(peak_at, sizeof(peak_at), "%s", formatTimestamp(tracker.peak_timestamp));
+    }
+    const char* timestamp = formatTimestamp(rawClockReader(channel_registry->clock_source)());
+    char* line = reserveLog(MAX_LINE_LENGTH);
+    int length = snprintf(line, MAX_LINE_LENGTH, "[%s] PID=%u, process=%s, %s: live_bytes=%" PRIu64 ", live_blocks=%" PRIu64
+                          ", peak_bytes=%" PRIu64 ", peak_at=%s, allocated=%" PRIu64 ", freed=%" PRIu64
+                          ", unknown_frees=%" PRIu64, timestamp, channel.process.pid, channel.process.name.c_str(), kind,
+                          tracker.live_bytes, tracker.live_count, tracker.peak_bytes, peak_at, tracker.allocated_count,
+                          tracker.freed_count, tracker.unknown_frees);
+    length = std::min(length, static_cast<int>(MAX_LINE_LENGTH) - 1);
+    if (tracker.live_count != 0) {
+        length += formatHistogram(line + length, MAX_LINE_LENGTH - length - 1, "live_sizes", tracker.live_size_counts,
+                                  EMPTY_HISTOGRAM, SIZE_HISTOGRAM_BUCKETS, false);
+    }
+    line[length++] = '\n';
+    commitLog(length);
+
+    std::vector<uint32_t> sites;
+    for (uint32_t id = 1; id < tracker.call_sites.size(); ++id) {
+        if (tracker.call_sites[id].live_count != 0) {
+            sites.push_back(id);
+        }
+    }
+    size_t reported = std::min<size_t>(sites.size(), MAX_REPORTED_CALL_SITES);
+    std::partial_sort(sites.begin(), sites.begin() + reported, sites.end(), [&](uint32_t left, uint32_t right) {
+        return tracker.call_sites[left].live_bytes > tracker.call_sites[right].live_bytes;
+    });
+    for (size_t index = 0; index < reported; ++index) {
+        const CallSite& site = tracker.call_sites[sites[index]];
+        appendLogLine("[%s] PID=%u, process=%s, %s: stack=%u, live_bytes=%" PRIu64 ", live_blocks=%" PRIu64
+                      ", growth_bytes=%+" PRId64 ", frames=%s\n", timestamp, channel.process.pid,
+                      channel.process.name.c_str(), site_kind, sites[index], site.live_bytes, site.live_count,
+                      static_cast<int64_t>(site.live_bytes - site.reported_bytes),
+                      channel.call_site_names[sites[index]].c_str());
+    }
+    for (CallSite& site : tracker.call_sites) {
+        site.reported_bytes = site.live_bytes;
+    }
+}
+
+void reportAllChannelAllocations() {
+    for (const std::unique_ptr<ProcessChannel>& channel : channels) {
+        if (channel != nullptr && channel->allocations != nullptr) {
+            reportAllocations(*channel, "allocations", "call_site");
+        }
+    }
+}
+
+// Unmap the channels drained for the last time, after logging the final flush of their summaries
+void releaseClosedChannels() {
+    for (uint32_t index = 0; index < channels.size(); ++index) {
+        std::unique_ptr<ProcessChannel>& channel = channels[index];
+        if (channel == nullptr || !channel->closing) {
+            continue;
+        }
+        snapshotSummary(*channel, formatTimestamp(rawClockReader(channel_registry->clock_source)()));
+        if (channel->allocations != nullptr) {
+            reportAllocations(*channel, "leaks", "leak_site");
+        }
+        munmap(channel->header, channel->size);
+        channel.reset();
+        ChannelEntry* entry = channelEntry(channel_registry, index);
+        entry->pid.store(0, std::memory_order_relaxed);
+        entry->state.store(CHANNEL_FREE, std::memory_order_release);
+    }
+}
+
+// Log percentiles of the latency histograms and start the next interval
+void reportLatencies() {
+    const char* timestamp = formatTimestamp(rawClockReader(channel_registry->clock_source)());
+    for (const auto& entry : latency_stats) {
+        const LatencyKey& key = entry.first;
+        const LatencyHistogram& histogram = entry.second.histogram;
+        appendLogLine("[%s] PID=%u, process=%s, latency: operation=%s%s%s, count=%" PRIu64
+                      ", p50_us=%.3f, p99_us=%.3f, p99.9_us=%.3f, max_us=%.3f\n",
+                      timestamp, key.pid, entry.second.process_name.c_str(), eventOpcodeName(key.opcode),
+                      key.file != 0 ? ", file=" : "", latency_files[key.file].c_str(), histogram.total_count,
+                      histogram.valueAtPercentile(50.0) / 1000.0, histogram.valueAtPercentile(99.0) / 1000.0,
+                      histogram.valueAtPercentile(99.9) / 1000.0, histogram.max_value / 1000.0);
+    }
+    latency_stats.clear();
+}
+
+// Summary snapshots and latency reports that are due
+void runPeriodicReports(bool force) {
+    time_t now = time(nullptr);
+    if (force || now - summary_snapshot_at >= static_cast<time_t>(daemon_options.summary_interval)) {
+        snapshotSummaries();
+        summary_snapshot_at = now;
+    }
+    if (daemon_options.latency_interval != 0 &&
+        (force || now - latency_report_at >= static_cast<time_t>(daemon_options.latency_interval))) {
+        reportLatencies();
+        latency_report_at = now;
+    }
+    if (daemon_options.allocation_interval != 0 &&
+        (force || now - allocation_report_at >= static_cast<time_t>(daemon_options.allocation_interval))) {
+        reportAllChannelAllocations();
+        allocation_report_at = now;
+    }
+}
+
+bool isAnyRingAboveHighWater() {
+    for (const std::unique_ptr<ProcessChannel>& channel : channels) {
+        if (channel == nullptr) {
+            continue;
+        }
+        for (uint32_t index = 0; index < channel->header->ring_count; ++index) {
+            RingSlot* slot = ringSlot(channel->header, index);
+            if (slot->head.load(std::memory_order_relaxed) - slot->tail.load(std::memory_order_relaxed) >=
+                channel->header->high_water_mark) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// Block until a producer rings the doorbell, a channel is registered or closed, or the poll interval expires
+void waitForEvents(int poll_interval) {
+    channel_registry->consumer_waiting.store(1, std::memory_order_relaxed);
+    // Pairs with the fence producers execute after publishing a record that crossed the high-water mark
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    uint32_t doorbell = channel_registry->doorbell.load(std::memory_order_acquire);
+    if (running && !isAnyRingAboveHighWater() &&
+        channel_registry->generation.load(std::memory_order_acquire) == scanned_generation) {
+        struct timespec timeout = {poll_interval, 0};
+        waitDoorbell(channel_registry, doorbell, timeout);
+    }
+    channel_registry->consumer_waiting.store(0, std::memory_order_relaxed);
+}
+
+// Daemon function to initialize shared memory and log file
+void daemonize(const char* daemon_mode, const char* log_file_name, int poll_interval, const DaemonOptions& options) {
+    if (strcmp(daemon_mode, "fileio") == 0) {
+        shared_memory_name = SHARED_MEMORY_FILEIO_NAME;
+    } else if (strcmp(daemon_mode, "memmgmt") == 0){
+        shared_memory_name = SHARED_MEMORY_MEMMGMT_NAME;
+    } else {
+        perror("daemon mod");
+        exit(EXIT_FAILURE);
+    }
+
+    daemon_options = options;
+    startLogWriter(log_writer, log_file_name);
+    if (options.columnar) {
+        startLogWriter(column_writer, std::string(log_file_name) + COLUMN_LOG_SUFFIX);
+    }
+    initializeSharedMemory(options);
+    summary_snapshot_at = time(nullptr);
+    latency_report_at = summary_snapshot_at;
+    allocation_report_at = summary_snapshot_at;
+    int wait_interval = std::min(poll_interval, static_cast<int>(options.summary_interval));
+    if (options.latency_interval != 0) {
+        wait_interval = std::min(wait_interval, static_cast<int>(options.latency_interval));
+    }
+    if (options.allocation_interval != 0) {
+        wait_interval = std::min(wait_interval, static_cast<int>(options.allocation_interval));
+    }
+
+    while (running) {
+        // During a burst output keeps accumulating in the current buffer, it is handed over before idling
+        refreshChannels();
+        size_t drained = drainRings();
+        runPeriodicReports(false);
+        releaseClosedChannels();
+        if (column_block.header.row_count != 0 && time(nullptr) - column_block_started_at >= COLUMN_BLOCK_SECONDS) {
+            flushColumnBlock();
+        }
+        if (drained < BURST_RECORDS) {
+            submitLogBuffer(log_writer);
+            waitForEvents(wait_interval);
+        }
+    }
+
+    refreshChannels();
+    drainRings();
+    releaseClosedChannels();
+    runPeriodicReports(true);
+    for (uint32_t index = 0; index < channels.size(); ++index) {
+        ChannelEntry* entry = channelEntry(channel_registry, index);
+        if (channels[index] != nullptr) {
+            munmap(channels[index]->header, channels[index]->size);
+            channels[index].reset();
+        } else if (entry->state.load(std::memory_order_acquire) != CHANNEL_FREE) {
+            // Registered but never attached, its segment still has a name
+            unlinkChannelSegment(index, entry->pid.load(std::memory_order_relaxed));
+        }
+    }
+    if (options.columnar) {
+        flushColumnBlock();
+        stopLogWriter(column_writer);
+    }
+    stopLogWriter(log_writer);
+    ChannelRegistry* registry = channel_registry;
+    channel_registry = nullptr;
+    munmap(registry, registry_size);
+    close(shared_memory_fd);
+    shm_unlink(shared_memory_name);
+}
+
+void printUsage(const char* program_name) {
+    std::cerr << "Usage: " << program_name << " <daemon_mode (fileio / memmgmt)> <log_file_name> <poll_interval>"
+              << " [-n channel_count] [-r ring_count] [-s ring_size_bytes] [-c clock (tsc / monotonic / coarse)]"
+              << " [-w high_water_percent] [-P preallocate_bytes] [-R rotate_bytes] [-T rotate_seconds]"
+              << " [-y sync (never / batch / seconds)] [-a summary_seconds]"
+              << " [-L latency_report_seconds] [-F] [-M allocation_report_seconds] [-Q] [-C]" << std::endl;
+}
+
+bool parseSyncPolicy(const char* value, DaemonOptions& options) {
+    if (strcmp(value, "never") == 0) {
+        options.sync_policy = SYNC_NEVER;
+    } else if (strcmp(value, "batch") == 0) {
+        options.sync_policy = SYNC_BATCH;
+    } else {
+        char* end = nullptr;
+        options.sync_interval = static_cast<uint32_t>(std::strtoul(value, &end, 10));
+        if (end == value || *end != '\0') {
+            return false;
+        }
+        options.sync_policy = SYNC_INTERVAL;
+    }
+    return true;
+}
+
+bool parseClockSource(const char* name, uint32_t& clock_source) {
+    if (strcmp(name, "tsc") == 0) {
+        clock_source = CLOCK_SOURCE_TSC;
+    } else if (strcmp(name, "monotonic") == 0) {
+        clock_source = CLOCK_SOURCE_MONOTONIC;
+    } else if (strcmp(name, "coarse") == 0) {
+        clock_source = CLOCK_SOURCE_MONOTONIC_COARSE;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    installSignalHandlers();
+    DaemonOptions options;
+    options.channel_count = DEFAULT_CHANNEL_COUNT;
+    options.ring_count = DEFAULT_RING_COUNT;
+    options.ring_size = DEFAULT_RING_SIZE;
+    options.clock_source = isInvariantTscAvailable() ? CLOCK_SOURCE_TSC : CLOCK_SOURCE_MONOTONIC;
+    options.high_water_percent = DEFAULT_HIGH_WATER_PERCENT;
+    options.preallocate_size = DEFAULT_PREALLOCATE_SIZE;
+    options.rotate_size = 0;
+    options.rotate_interval = 0;
+    options.sync_policy = SYNC_NEVER;
+    options.sync_interval = 0;
+    options.summary_interval = DEFAULT_SUMMARY_INTERVAL;
+    options.latency_interval = 0;
+    options.latency_per_file = false;
+    options.allocation_interval = 0;
+    options.render_events = true;
+    options.columnar = false;
+    int option;
+    while ((option = getopt(argc, argv, "n:r:s:c:w:P:R:T:y:a:L:FM:QC")) != -1) {
+        switch (option) {
+            case 'n':
+                options.channel_count = static_cast<uint32_t>(std::strtoul(optarg, nullptr, 10));
+                break;
+            case 'r':
+                options.ring_count = static_cast<uint32_t>(std::strtoul(optarg, nullptr, 10));
+                break;
+            case 's':
+                options.ring_size = static_cast<uint32_t>(std::strtoul(optarg, nullptr, 10));
+                break;
+            case 'w':
+                options.high_water_percent = static_cast<uint32_t>(std::strtoul(optarg, nullptr, 10));
+                break;
+            case 'P':
+                options.preallocate_size = std::strtoull(optarg, nullptr, 10);
+                break;
+            case 'R':
+                options.rotate_size = std::strtoull(optarg, nullptr, 10);
+                break;
+            case 'T':
+                options.rotate_interval = static_cast<uint32_t>(std::strtoul(optarg, nullptr, 10));
+                break;
+            case 'a':
+                options.summary_interval = static_cast<uint32_t>(std::strtoul(optarg, nullptr, 10));
+                break;
+            case 'L':
+                options.latency_interval = static_cast<uint32_t>(std::strtoul(optarg, nullptr, 10));
+                break;
+            case 'F':
+                options.latency_per_file = true;
+                break;
+            case 'M':
+                options.allocation_interval = static_cast<uint32_t>(std::strtoul(optarg, nullptr, 10));
+                break;
+            case 'Q':
+                options.render_events = false;
+                break;
+            case 'C':
+                options.columnar = true;
+                break;
+            case 'y':
+                if (!parseSyncPolicy(optarg, options)) {
+                    printUsage(argv[0]);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'c':
+                if (!parseClockSource(optarg, options.clock_source)) {
+                    printUsage(argv[0]);
+                    return EXIT_FAILURE;
+                }
+                break;
+            default:
+                printUsage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (argc - optind != 3) {
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (options.channel_count == 0 || options.channel_count > MAX_CHANNEL_COUNT ||
+        options.ring_count < 2 || options.ring_count > MAX_RING_COUNT || !isPowerOfTwo(options.ring_size) ||
+        options.ring_size < MIN_RING_SIZE || options.ring_size > MAX_RING_SIZE ||
+        options.high_water_percent == 0 || options.high_water_percent > 100 || options.summary_interval == 0) {
+        std::cerr << "channel_count must be in [1, " << MAX_CHANNEL_COUNT << "], ring_count in [2, " << MAX_RING_COUNT << "], ring_size a power of two in ["
+                  << MIN_RING_SIZE << ", " << MAX_RING_SIZE << "], high_water_percent in [1, 100], "
+                  << "summary_seconds at least 1" << std::endl;
+        return EXIT_FAILURE;
+    }
+    daemonize(argv[optind], argv[optind + 1], std::atoi(argv[optind + 2]), options);
+    return EXIT_SUCCESS;
 }
\ No newline at end of file
@@ -0,0 +1,205 @@
+#ifndef LIBCLOG_EVENT_FORMAT_H
+#define LIBCLOG_EVENT_FORMAT_H
+
+#include <algorithm>
+#include <cinttypes>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <sys/types.h>
+
+#include "clock_source.h"
+#include "event_record.h"
+
+// Text rendering of event records, shared by the daemon and libclog-query so both produce
+// the same log lines.
+
+const size_t MAX_LINE_LENGTH = 2 * PATH_MAX + 512;
+
+// localtime_r only runs when the rendered second changes
+struct TimestampCache {
+    time_t second;
+    char text[32];
+    char rendered[40];
+};
+
+// Render a raw event timestamp as "YYYY-MM-DD hh:mm:ss.mmm" in local time, into the cache
+inline const char* formatTimestamp(TimestampCache& cache, const ClockAnchor& anchor, uint64_t raw_timestamp) {
+    uint64_t timestamp = rawClockToRealtime(anchor, raw_timestamp);
+    time_t second = static_cast<time_t>(timestamp / 1000000000ull);
+    if (second != cache.second) {
+        struct tm time_info;
+        localtime_r(&second, &time_info);
+        strftime(cache.text, sizeof(cache.text), "%Y-%m-%d %H:%M:%S", &time_info);
+        cache.second = second;
+    }
+    snprintf(cache.rendered, sizeof(cache.rendered), "%s.%03u", cache.text,
+             static_cast<unsigned>(timestamp / 1000000ull % 1000));
+    return cache.rendered;
+}
+
+inline uint64_t eventArgument(const EventRecord* event, uint32_t index) {
+    return index < event->argument_count ? eventArguments(event)[index] : 0;
+}
+
+// Render one value as described by a "name:format" entry of the opcode table
+inline int formatEventValue(char* output, size_t remaining, const char* separator, const char* entry,
+                            size_t entry_length, uint64_t value) {
+    const char* colon = static_cast<const char*>(memchr(entry, ':', entry_length));
+    if (colon == nullptr) {
+        return 0;
+    }
+    int name_length = static_cast<int>(colon - entry);
+    switch (colon[1]) {
+        case 'd':
+            return snprintf(output, remaining, "%s%.*s=%" PRId64, separator, name_length, entry, static_cast<int64_t>(value));
+        case 'p':
+            return snprintf(output, remaining, "%s%.*s=%p", separator, name_length, entry, reinterpret_cast<void*>(value));
+        case 'x':
+            return snprintf(output, remaining, "%s%.*s=0x%" PRIx64, separator, name_length, entry, value);
+        case 'o':
+            return snprintf(output, remaining, "%s%.*s=0%" PRIo64, separator, name_length, entry, value);
+        default:
+            return snprintf(output, remaining, "%s%.*s=%" PRIu64, separator, name_length, entry, value);
+    }
+}
+
+// Render an event from its opcode table entry: "name: string=..., argument=..., result=..."
+inline int formatTableEvent(const EventRecord* event, char* output, size_t remaining) {
+    int length = snprintf(output, remaining, "%s:", EVENT_OPCODE_NAMES[event->opcode]);
+    const char* separator = " ";
+    auto append = [&](int written) {
+        if (written > 0) {
+            length += written;
+            separator = ", ";
+        }
+    };
+    if (*EVENT_STRING_NAMES[event->opcode] != '\0' && static_cast<size_t>(length) < remaining) {
+        append(snprintf(output + length, remaining - length, "%s%s=%.*s", separator, EVENT_STRING_NAMES[event->opcode],
+                        static_cast<int>(event->string_length), eventString(event)));
+    }
+    const char* entry = EVENT_ARGUMENT_FORMATS[event->opcode];
+    for (uint32_t index = 0; *entry != '\0' && static_cast<size_t>(length) < remaining; ++index) {
+        const char* comma = strchr(entry, ',');
+        size_t entry_length = comma != nullptr ? static_cast<size_t>(comma - entry) : strlen(entry);
+        append(formatEventValue(output + length, remaining - length, separator, entry, entry_length,
+                                eventArgument(event, index)));
+        entry += entry_length + (comma != nullptr ? 1 : 0);
+    }
+    const char* result = EVENT_RESULT_FORMATS[event->opcode];
+    if (*result != '\0' && static_cast<size_t>(length) < remaining) {
+        append(formatEventValue(output + length, remaining - length, separator, result, strlen(result),
+                                static_cast<uint64_t>(event->result)));
+    }
+    return length;
+}
+
+// Render one event as a human-readable log line, returns the line length.
+// path is the file the event's descriptor refers to, appended to events that carry no filename.
+inline int formatEvent(const EventRecord* event, uint32_t pid, const char* process_name, const char* path,
+                       size_t path_length, const ClockAnchor& anchor, TimestampCache& cache, char* line, size_t size) {
+    int length = snprintf(line, size, "[%s] PID=%u, process=%s, ",
+                          formatTimestamp(cache, anchor, event->timestamp), pid, process_name);
+    char* output = line + length;
+    size_t remaining = size - length;
+    switch (event->opcode) {
+        case OP_OPEN: {
+            int flags = static_cast<int>(eventArgument(event, 0));
+            length += snprintf(output, remaining, "open: filename=%.*s, flags=%d, file_descriptor=%d",
+                               static_cast<int>(event->string_length), eventString(event),
+                               flags, static_cast<int>(event->result));
+            // The mode is only meaningful when the call could create the file
+            if ((flags & O_CREAT) != 0 || (flags & O_TMPFILE) == O_TMPFILE) {
+                length += snprintf(line + length, size - std::min<size_t>(length, size), ", mode=%o",
+                                   static_cast<unsigned>(eventArgument(event, 1)));
+            }
+            break;
+        }
+        case OP_CLOSE:
+            length += snprintf(output, remaining, "close: file_descriptor=%d, return_code=%d",
+                               static_cast<int>(eventArgument(event, 0)), static_cast<int>(event->result));
+            break;
+        case OP_LSEEK:
+            length += snprintf(output, remaining, "lseek: file_descriptor=%d, requested_offset=%ld, whence=%d, resulted_offset=%ld",
+                               static_cast<int>(eventArgument(event, 0)), static_cast<long>(eventArgument(event, 1)),
+                               static_cast<int>(eventArgument(event, 2)), static_cast<long>(event->result));
+            break;
+        case OP_READ:
+            length += snprintf(output, remaining, "read: file_descriptor=%d, buffer_pointer=%p, count=%zu, bytes_read=%zd",
+                               static_cast<int>(eventArgument(event, 0)), reinterpret_cast<void*>(eventArgument(event, 1)),
+                               static_cast<size_t>(eventArgument(event, 2)), static_cast<ssize_t>(event->result));
+            break;
+        case OP_WRITE:
+            length += snprintf(output, remaining, "write: file_descriptor=%d, buffer_pointer=%p, count=%zu, bytes_written=%zd",
+                               static_cast<int>(eventArgument(event, 0)), reinterpret_cast<void*>(eventArgument(event, 1)),
+                               static_cast<size_t>(eventArgument(event, 2)), static_cast<ssize_t>(event->result));
+            break;
+        case OP_MALLOC:
+            length += snprintf(output, remaining, "malloc: bytes_requested=%zu, new_mem_pointer=%p",
+                               static_cast<size_t>(eventArgument(event, 0)), reinterpret_cast<void*>(event->result));
+            break;
+        case OP_REALLOC:
+            length += snprintf(output, remaining, "realloc: bytes_requested=%zu, current_mem_pointer=%p, new_mem_pointer=%p",
+                               static_cast<size_t>(eventArgument(event, 1)), reinterpret_cast<void*>(eventArgument(event, 0)),
+                               reinterpret_cast<void*>(event->result));
+            break;
+        case OP_CALLOC:
+            length += snprintf(output, remaining, "calloc: count=%zu, element_size=%zu, new_mem_pointer=%p",
+                               static_cast<size_t>(eventArgument(event, 0)), static_cast<size_t>(eventArgument(event, 1)),
+                               reinterpret_cast<void*>(event->result));
+            break;
+        case OP_POSIX_MEMALIGN:
+            length += snprintf(output, remaining, "posix_memalign: alignment=%zu, bytes_requested=%zu, new_mem_pointer=%p, return_code=%d",
+                               static_cast<size_t>(eventArgument(event, 0)), static_cast<size_t>(eventArgument(event, 1)),
+                               reinterpret_cast<void*>(event->result), static_cast<int>(eventArgument(event, 2)));
+            break;
+        case OP_ALIGNED_ALLOC:
+        case OP_MEMALIGN:
+            length += snprintf(output, remaining, "%s: alignment=%zu, bytes_requested=%zu, new_mem_pointer=%p",
+                               event->opcode == OP_MEMALIGN ? "memalign" : "aligned_alloc",
+                               static_cast<size_t>(eventArgument(event, 0)), static_cast<size_t>(eventArgument(event, 1)),
+                               reinterpret_cast<void*>(event->result));
+            break;
+        case OP_VALLOC:
+            length += snprintf(output, remaining, "valloc: bytes_requested=%zu, new_mem_pointer=%p",
+                               static_cast<size_t>(eventArgument(event, 0)), reinterpret_cast<void*>(event->result));
+            break;
+        case OP_SAMPLING: {
+            uint64_t calls = eventArgument(event, 1);
+            uint64_t logged = eventArgument(event, 2);
+            length += snprintf(output, remaining, "sampling: operation=%s, calls=%" PRIu64 ", logged=%" PRIu64
+                               ", every=%" PRIu64 ", rate=%" PRIu64 ", scale=%.3f",
+                               eventOpcodeName(static_cast<uint32_t>(eventArgument(event, 0))), calls, logged,
+                               eventArgument(event, 3), eventArgument(event, 4),
+                               logged != 0 ? static_cast<double>(calls) / logged : 0.0);
+            break;
+        }
+        case OP_FREE:
+            length += snprintf(output, remaining, "free: mem_pointer=%p", reinterpret_cast<void*>(eventArgument(event, 0)));
+            break;
+        default:
+            if (event->opcode < OP_COUNT) {
+                length += formatTableEvent(event, output, remaining);
+            } else {
+                length += snprintf(output, remaining, "unknown opcode=%u", static_cast<unsigned>(event->opcode));
+            }
+            break;
+    }
+    if (path_length != 0 && event->opcode < OP_COUNT && *EVENT_STRING_NAMES[event->opcode] == '\0' &&
+        static_cast<size_t>(length) < size) {
+        length += snprintf(line + length, size - length, ", path=%.*s", static_cast<int>(path_length), path);
+    }
+    if (static_cast<size_t>(length) < size) {
+        if (event->opcode == OP_SAMPLING) {
+            length += snprintf(line + length, size - length, "\n");
+        } else {
+            length += snprintf(line + length, size - length, ", duration_ns=%" PRIu64 "\n",
+                               rawClockToNanoseconds(anchor, event->duration));
+        }
+    }
+    return std::min(length, static_cast<int>(size) - 1);
+}
+
+#endif // LIBCLOG_EVENT_FORMAT_H
@@ -0,0 +1,108 @@
+#ifndef LIBCLOG_EVENT_RECORD_H
+#define LIBCLOG_EVENT_RECORD_H
+
+#include <cstdint>
+
+// Binary event written by the interceptor into a ring record and rendered to text by the daemon.
+//
+//   [EventRecord][uint64_t arguments x argument_count][string_length bytes]
+//
+// The string area holds variable-length payloads such as filenames, without a terminating NUL.
+//
+// File I/O events carry the path id of their descriptor in file. A process announces each path
+// id once per channel with an OP_PATH record holding the path, ahead of the first event using it.
+
+// Every event type: X(opcode, name, string, arguments, result).
+// string names the string payload, arguments lists the logged arguments in order as name:format
+// and result names the return value, "" when there is none. Formats: d signed, u unsigned,
+// p pointer, x hexadecimal, o octal.
+#define EVENT_OPCODES(X) \
+    X(OP_OPEN,           "open",           "filename", "flags:d,mode:o",                                   "file_descriptor:d") \
+    X(OP_CLOSE,          "close",          "",         "file_descriptor:d",                                "return_code:d") \
+    X(OP_LSEEK,          "lseek",          "",         "file_descriptor:d,offset:d,whence:d",              "resulted_offset:d") \
+    X(OP_READ,           "read",           "",         "file_descriptor:d,buffer:p,count:u",               "bytes_read:d") \
+    X(OP_WRITE,          "write",          "",         "file_descriptor:d,buffer:p,count:u",               "bytes_written:d") \
+    X(OP_MALLOC,         "malloc",         "",         "size:u",                                           "pointer:p") \
+    X(OP_REALLOC,        "realloc",        "",         "pointer:p,size:u,old_usable_size:u",               "new_pointer:p") \
+    X(OP_FREE,           "free",           "",         "pointer:p",                                        "") \
+    X(OP_CALLOC,         "calloc",         "",         "count:u,size:u",                                   "pointer:p") \
+    X(OP_POSIX_MEMALIGN, "posix_memalign", "",         "alignment:u,size:u,return_code:d",                 "pointer:p") \
+    X(OP_ALIGNED_ALLOC,  "aligned_alloc",  "",         "alignment:u,size:u",                               "pointer:p") \
+    X(OP_MEMALIGN,       "memalign",       "",         "alignment:u,size:u",                               "pointer:p") \
+    X(OP_VALLOC,         "valloc",         "",         "size:u",                                           "pointer:p") \
+    X(OP_SAMPLING,       "sampling",       "",         "opcode:u,seen:u,logged:u,every:u,rate:u",          "") \
+    X(OP_OPENAT,         "openat",         "filename", "dirfd:d,flags:d,mode:o",                           "file_descriptor:d") \
+    X(OP_PREAD,          "pread",          "",         "file_descriptor:d,buffer:p,count:u,offset:d",      "bytes_read:d") \
+    X(OP_PWRITE,         "pwrite",         "",         "file_descriptor:d,buffer:p,count:u,offset:d",      "bytes_written:d") \
+    X(OP_READV,          "readv",          "",         "file_descriptor:d,iov:p,iovcnt:d",                 "bytes_read:d") \
+    X(OP_WRITEV,         "writev",         "",         "file_descriptor:d,iov:p,iovcnt:d",                 "bytes_written:d") \
+    X(OP_FSYNC,          "fsync",          "",         "file_descriptor:d",                                "return_code:d") \
+    X(OP_FDATASYNC,      "fdatasync",      "",         "file_descriptor:d",                                "return_code:d") \
+    X(OP_SENDFILE,       "sendfile",       "",         "out_fd:d,in_fd:d,offset_pointer:p,count:u",        "bytes_sent:d") \
+    X(OP_MMAP,           "mmap",           "",         "address:p,length:u,prot:x,flags:x,fd:d,offset:d",  "mapped_pointer:p") \
+    X(OP_MUNMAP,         "munmap",         "",         "address:p,length:u",                               "return_code:d") \
+    X(OP_FOPEN,          "fopen",          "filename", "",                                                 "file_descriptor:d") \
+    X(OP_FCLOSE,         "fclose",         "",         "file_descriptor:d",                                "return_code:d") \
+    X(OP_FREAD,          "fread",          "",         "file_descriptor:d,buffer:p,size:u,count:u",        "items_read:u") \
+    X(OP_FWRITE,         "fwrite",         "",         "file_descriptor:d,buffer:p,size:u,count:u",        "items_written:u") \
+    X(OP_PATH,           "path",           "path",     "path_id:u",                                        "")
+
+enum EventOpcode : uint8_t {
+#define EVENT_OPCODE_ENUM(opcode, name, string, arguments, result) opcode,
+    EVENT_OPCODES(EVENT_OPCODE_ENUM)
+#undef EVENT_OPCODE_ENUM
+    OP_COUNT
+};
+
+#define EVENT_OPCODE_NAME(opcode, name, string, arguments, result) name,
+#define EVENT_OPCODE_STRING(opcode, name, string, arguments, result) string,
+#define EVENT_OPCODE_ARGUMENTS(opcode, name, string, arguments, result) arguments,
+#define EVENT_OPCODE_RESULT(opcode, name, string, arguments, result) result,
+const char* const EVENT_OPCODE_NAMES[OP_COUNT] = {EVENT_OPCODES(EVENT_OPCODE_NAME)};
+const char* const EVENT_STRING_NAMES[OP_COUNT] = {EVENT_OPCODES(EVENT_OPCODE_STRING)};
+const char* const EVENT_ARGUMENT_FORMATS[OP_COUNT] = {EVENT_OPCODES(EVENT_OPCODE_ARGUMENTS)};
+const char* const EVENT_RESULT_FORMATS[OP_COUNT] = {EVENT_OPCODES(EVENT_OPCODE_RESULT)};
+#undef EVENT_OPCODE_NAME
+#undef EVENT_OPCODE_STRING
+#undef EVENT_OPCODE_ARGUMENTS
+#undef EVENT_OPCODE_RESULT
+
+// Operation filters keep one bit per opcode
+static_assert(OP_COUNT <= 64, "Operation masks hold at most 64 opcodes");
+
+struct EventRecord {
+    uint8_t opcode;
+    uint8_t argument_count;
+    uint16_t string_length;
+    uint32_t tid;
+    uint64_t timestamp;  // Raw clock when the libc call started
+    uint64_t duration;   // Raw clock ticks spent in the libc call
+    int64_t result;
+    uint32_t file;       // Path id of the descriptor the call used, NO_PATH when unknown
+    uint32_t reserved;
+};
+
+const uint32_t MAX_EVENT_ARGUMENTS = 8;
+const uint32_t MAX_EVENT_STRING_LENGTH = 4095;
+
+// Path ids are interned per process and stay below PATH_TABLE_SIZE
+const uint32_t NO_PATH = 0;
+const uint32_t PATH_TABLE_SIZE = 16384;
+
+inline const char* eventOpcodeName(uint32_t opcode) {
+    return opcode < OP_COUNT ? EVENT_OPCODE_NAMES[opcode] : "unknown";
+}
+
+inline const uint64_t* eventArguments(const EventRecord* event) {
+    return reinterpret_cast<const uint64_t*>(event + 1);
+}
+
+inline const char* eventString(const EventRecord* event) {
+    return reinterpret_cast<const char*>(eventArguments(event) + event->argument_count);
+}
+
+inline uint32_t eventLength(uint32_t argument_count, uint32_t string_length) {
+    return sizeof(EventRecord) + argument_count * sizeof(uint64_t) + string_length;
+}
+
+#endif // LIBCLOG_EVENT_RECORD_H
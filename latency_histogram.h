@@ -0,0 +1,71 @@
+#ifndef LIBCLOG_LATENCY_HISTOGRAM_H
+#define LIBCLOG_LATENCY_HISTOGRAM_H
+
+#include <cstdint>
+#include <vector>
+
+// HDR-style latency histogram: values below LATENCY_SUB_BUCKET_COUNT are counted exactly, larger
+// values in LATENCY_SUB_BUCKET_COUNT / 2 linear sub-buckets per power of two, so a reported
+// percentile is at most 1 / 64 above the recorded value. The bucket array only grows up to the
+// largest value seen.
+
+const uint32_t LATENCY_SUB_BUCKET_BITS = 7;
+const uint32_t LATENCY_SUB_BUCKET_COUNT = 1u << LATENCY_SUB_BUCKET_BITS;
+const uint32_t LATENCY_SUB_BUCKET_HALF = LATENCY_SUB_BUCKET_COUNT / 2;
+
+inline uint32_t latencyBucket(uint64_t value) {
+    if (value < LATENCY_SUB_BUCKET_COUNT) {
+        return static_cast<uint32_t>(value);
+    }
+    uint32_t shift = 63 - __builtin_clzll(value) - (LATENCY_SUB_BUCKET_BITS - 1);
+    return LATENCY_SUB_BUCKET_COUNT + (shift - 1) * LATENCY_SUB_BUCKET_HALF +
+           static_cast<uint32_t>(value >> shift) - LATENCY_SUB_BUCKET_HALF;
+}
+
+// Largest value counted in a bucket
+inline uint64_t latencyBucketHighestValue(uint32_t bucket) {
+    if (bucket < LATENCY_SUB_BUCKET_COUNT) {
+        return bucket;
+    }
+    uint32_t shift = (bucket - LATENCY_SUB_BUCKET_COUNT) / LATENCY_SUB_BUCKET_HALF + 1;
+    uint64_t sub_bucket = (bucket - LATENCY_SUB_BUCKET_COUNT) % LATENCY_SUB_BUCKET_HALF + LATENCY_SUB_BUCKET_HALF;
+    return ((sub_bucket + 1) << shift) - 1;
+}
+
+struct LatencyHistogram {
+    std::vector<uint64_t> counts;
+    uint64_t total_count;
+    uint64_t max_value;
+
+    LatencyHistogram() : total_count(0), max_value(0) {}
+
+    void record(uint64_t value) {
+        uint32_t bucket = latencyBucket(value);
+        if (bucket >= counts.size()) {
+            counts.resize(bucket + 1, 0);
+        }
+        ++counts[bucket];
+        ++total_count;
+        max_value = value > max_value ? value : max_value;
+    }
+
+    // Highest value equivalent to the one at the given percentile, the exact maximum at 100
+    uint64_t valueAtPercentile(double percentile) const {
+        if (total_count == 0) {
+            return 0;
+        }
+        uint64_t rank = static_cast<uint64_t>(percentile / 100.0 * total_count + 0.5);
+        rank = rank == 0 ? 1 : rank;
+        uint64_t seen = 0;
+        for (uint32_t bucket = 0; bucket < counts.size(); ++bucket) {
+            seen += counts[bucket];
+            if (seen >= rank) {
+                uint64_t value = latencyBucketHighestValue(bucket);
+                return value < max_value ? value : max_value;
+            }
+        }
+        return max_value;
+    }
+};
+
+#endif // LIBCLOG_LATENCY_HISTOGRAM_H
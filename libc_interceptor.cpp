@@ -1,224 +1,1415 @@
-#include <cstdio>
-#include <cstring>
-#include <sys/mman.h>
-#include <unistd.h>
-#include <dlfcn.h>
-#include <cstdlib>
-#include <fcntl.h>
-#include <string>
-#include <chrono>
-#include <atomic>
-#include <stdarg.h>
-#include <limits.h>
-
-// Constants for shared memory and semaphores
-const int SHARED_MEMORY_SIZE = 4096;
-const char* SHARED_MEMORY_FILEIO_NAME = "/shm_fileio";
-const char* SHARED_MEMORY_MEMMGMT_NAME = "/shm_memmgmt";
-
-struct SharedMemoryData {
-    std::atomic<int> offset;
-    char buffer[SHARED_MEMORY_SIZE - sizeof(std::atomic<int>)];
-};
-
-// Shared resources
-SharedMemoryData* shared_memory_data_fileio = nullptr;
-SharedMemoryData* shared_memory_data_memmgmt = nullptr;
-std::string process_name = "";
-
-void handleError(bool condition, const char* error_message) {
-    if (condition) {
-        perror(error_message);
-        exit(EXIT_FAILURE);
-    }
-}
-
-void getCurrentProcessName() {
-    if (process_name.empty()) {
-        pid_t pid = getpid();
-        std::string path = "/proc/" + std::to_string(pid) + "/exe";
-        char exe_path[PATH_MAX];
-        ssize_t len = readlink(path.c_str(), exe_path, sizeof(exe_path) - 1);
-        handleError(len == -1, "Failed to read exe link");
-        exe_path[len] = '\0';
-        process_name = std::string(exe_path);
-        handleError(process_name.empty(), "Failed to retrieve process name");
-    }
-}
-
-std::string getCurrentTimestamp() {
-    auto now = std::chrono::system_clock::now();
-    auto now_time_t = std::chrono::system_clock::to_time_t(now);
-    auto milliseconds = std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()) % 1000;
-    char timestamp[128];
-    std::tm* time_info = std::localtime(&now_time_t);
-    snprintf(timestamp, sizeof(timestamp), "%04d-%02d-%02d %02d:%02d:%02d.%03ld",
-                time_info->tm_year + 1900, time_info->tm_mon + 1, time_info->tm_mday,
-                time_info->tm_hour, time_info->tm_min, time_info->tm_sec, milliseconds.count());
-    return std::string(timestamp);
-}
-
-void initializeSharedMemory(const char* shm_name, SharedMemoryData*& shared_memory_buffer) {
-    int shared_memory_fd = shm_open(shm_name, O_RDWR, 0666);
-    handleError(shared_memory_fd == -1, "Failed to open shared memory");
-    handleError(ftruncate(shared_memory_fd, sizeof(SharedMemoryData)) == -1, "Failed to set shared memory size");
-    shared_memory_buffer = static_cast<SharedMemoryData*>(mmap(nullptr, sizeof(SharedMemoryData), PROT_READ | PROT_WRITE, MAP_SHARED, shared_memory_fd, 0));
-    handleError(shared_memory_buffer == MAP_FAILED, "Failed to map shared memory");
-}
-
-void writeToSharedMemory(SharedMemoryData* shared_memory_data, const char* message) {
-    int message_length = std::min(static_cast<int>(strlen(message)), 256);
-    int current_offset = shared_memory_data->offset.load(std::memory_order_relaxed);
-    while (true) {
-        int new_offset = current_offset + message_length;
-        if (new_offset >= SHARED_MEMORY_SIZE - sizeof(std::atomic<int>)) {
-            new_offset = 0; 
-        }
-        if (shared_memory_data->offset.compare_exchange_weak(current_offset, new_offset, std::memory_order_acquire, std::memory_order_relaxed)) {
-            memcpy(shared_memory_data->buffer + current_offset, message, message_length);
-            break;
-        } else {
-            current_offset = shared_memory_data->offset.load(std::memory_order_relaxed);
-        }
-    }
-}
-
-// Function pointers for libc functions
-int (*libc_open)(const char*, int, ...) = nullptr;
-int (*libc_close)(int) = nullptr;
-off_t (*libc_lseek)(int, off_t, int) = nullptr;
-ssize_t (*libc_read)(int, void*, size_t) = nullptr;
-ssize_t (*libc_write)(int, const void*, size_t) = nullptr;
-void* (*libc_malloc)(size_t) = nullptr;
-void* (*libc_realloc)(void*, size_t) = nullptr;
-void (*libc_free)(void*) = nullptr;
-
-__attribute__((constructor))
-void initializeLibrary() {
-    initializeSharedMemory(SHARED_MEMORY_FILEIO_NAME, shared_memory_data_fileio);
-    initializeSharedMemory(SHARED_MEMORY_MEMMGMT_NAME, shared_memory_data_memmgmt);
-
-    // Load libc function pointers (dlopen + Lazy = crash)
-    libc_open = (int (*)(const char*, int, ...))dlsym(RTLD_NEXT, "open");
-    libc_close = (int (*)(int))dlsym(RTLD_NEXT, "close");
-    libc_lseek = (off_t (*)(int, off_t, int))dlsym(RTLD_NEXT, "lseek");
-    libc_read = (ssize_t (*)(int, void*, size_t))dlsym(RTLD_NEXT, "read");
-    libc_write = (ssize_t (*)(int, const void*, size_t))dlsym(RTLD_NEXT, "write");
-    libc_malloc = (void* (*)(size_t))dlsym(RTLD_NEXT, "malloc");
-    libc_realloc = (void* (*)(void*, size_t))dlsym(RTLD_NEXT, "realloc");
-    libc_free = (void (*)(void*))dlsym(RTLD_NEXT, "free");
-    handleError(!libc_open || !libc_close || !libc_lseek || !libc_read || !libc_write ||
-                !libc_malloc || !libc_realloc || !libc_free,
-                "Failed to load libc functions");
-    getCurrentProcessName();
-}
-
-// Cleanup the library
-__attribute__((destructor))
-void finalizeLibrary() {
-    munmap(shared_memory_data_fileio, SHARED_MEMORY_SIZE);
-    munmap(shared_memory_data_memmgmt, SHARED_MEMORY_SIZE);
-}
-
-// Intercepted libc functions
-extern "C" {
-    int open(const char* filename, int flags, ...) {
-        handleError(!libc_open, "libc_open is null");
-        va_list args;
-        va_start(args, flags);
-        int file_descriptor = libc_open(filename, flags, args);
-        va_end(args);
-        char log_message[256];
-        std::string timestamp = getCurrentTimestamp();
-        snprintf(log_message, sizeof(log_message), 
-                    "[%s] PID=%d, process=%s, open: filename=%s, flags=%d, file_descriptor=%d\n",
-                    timestamp.c_str(), getpid(), process_name.c_str(), filename, flags, file_descriptor);
-        writeToSharedMemory(shared_memory_data_fileio, log_message);
-        return file_descriptor;
-    }
-
-    int close(int fd) {
-        handleError(!libc_close, "libc_close is null");
-        int return_code = libc_close(fd);
-        char log_message[256];
-        std::string timestamp = getCurrentTimestamp();    
-        snprintf(log_message, sizeof(log_message), 
-                    "[%s] PID=%d, process=%s, close: file_descriptor=%d, return_code=%d\n",
-                    timestamp.c_str(), getpid(), process_name.c_str(), fd, return_code);
-        writeToSharedMemory(shared_memory_data_fileio, log_message);
-        return return_code;
-    }
-
-    off_t lseek(int fd, off_t offset, int whence) {
-        handleError(!libc_lseek, "libc_lseek is null");
-        off_t result = libc_lseek(fd, offset, whence);
-        char log_message[256];
-        std::string timestamp = getCurrentTimestamp();;
-        snprintf(log_message, sizeof(log_message), 
-                    "[%s] PID=%d, process=%s, lseek: file_descriptor=%d, requested_offset=%ld, whence=%d, resulted_offset=%ld\n",
-                    timestamp.c_str(), getpid(), process_name.c_str(), fd, offset, whence, result);
-        writeToSharedMemory(shared_memory_data_fileio, log_message);
-        return result;
-    }
-
-    ssize_t read(int fd, void* buffer, size_t count) {
-        handleError(!libc_read, "libc_read is null");
-        ssize_t bytes_read = libc_read(fd, buffer, count);
-        char log_message[256];
-        std::string timestamp = getCurrentTimestamp();
-        snprintf(log_message, sizeof(log_message), 
-                    "[%s] PID=%d, process=%s, read: file_descriptor=%d, buffer_pointer=%p, count=%zu, bytes_read=%zd\n",
-                    timestamp.c_str(), getpid(), process_name.c_str(), fd, buffer, count, bytes_read);
-        writeToSharedMemory(shared_memory_data_fileio, log_message);
-        return bytes_read;
-    }
-
-    ssize_t write(int fd, const void* buffer, size_t count) {
-        handleError(!libc_write, "libc_write is null");
-        ssize_t bytes_written = libc_write(fd, buffer, count);
-        char log_message[256];
-        std::string timestamp = getCurrentTimestamp();
-        snprintf(log_message, sizeof(log_message), 
-                    "[%s] PID=%d, process=%s, write: file_descriptor=%d, buffer_pointer=%p, count=%zu, bytes_written=%zd\n",
-                    timestamp.c_str(), getpid(), process_name.c_str(), fd, buffer, count, bytes_written);
-        writeToSharedMemory(shared_memory_data_fileio, log_message);
-        return bytes_written;
-    }
-
-    void* realloc(void* ptr, size_t size) {
-        handleError(!libc_realloc, "libc_realloc is null");
-        auto new_ptr = libc_realloc(ptr, size);
-        char log_message[256];
-        std::string timestamp = getCurrentTimestamp();
-        snprintf(log_message, sizeof(log_message),
-                    "[%s] PID=%d, process=%s, realloc: bytes_requested=%zu, current_mem_pointer=%p, new_mem_pointer=%p\n",
-                    timestamp.c_str(), getpid(), process_name.c_str(), size, ptr, new_ptr);
-        writeToSharedMemory(shared_memory_data_memmgmt, log_message);
-        return new_ptr;
-    }
-
-    void free(void* ptr) {
-        handleError(!libc_free, "libc_free is null");
-        libc_free(ptr);
-        char log_message[256];
-        snprintf(log_message, sizeof(log_message),
-                    "PID=%d, process=%s, free: mem_pointer=%p\n",
-                    getpid(), process_name.c_str(), ptr);
-        writeToSharedMemory(shared_memory_data_memmgmt, log_message);
-    }
-
-    /*
-    void* malloc(size_t size) {
-        handleError(!libc_malloc, "libc_malloc is null");           
-        void* pointer = libc_malloc(size);
-        char log_message[256];
-        std::string timestamp = getCurrentTimestamp();
-        
-        snprintf(log_message, sizeof(log_message), 
-                    " PID=%d, process=%s, malloc: bytes_requested=%zu, new_mem_pointer=%p\n",
-                    getpid(), process_name.c_str(), size, pointer);
-        writeToSharedMemory(shared_memory_data_memmgmt, log_message);
-        return pointer;
-    }
-    */
+#include <cstdio>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <dlfcn.h>
+#include <cstdlib>
+#include <fcntl.h>
+#include <pthread.h>
+#include <atomic>
+#include <stdarg.h>
+#include <limits.h>
+#include <cerrno>
+#include <cstdint>
+#include <algorithm>
+#include <fnmatch.h>
+#include <malloc.h>
+#include <sys/sendfile.h>
+#include <sys/uio.h>
+
+#include "shared_memory.h"
+#include "event_record.h"
+#include "clock_source.h"
+#include "allocation_tracker.h"
+#include "bootstrap_arena.h"
+
+enum Channel {
+    CHANNEL_FILEIO,
+    CHANNEL_MEMMGMT,
+    CHANNEL_COUNT
+};
+
+// Bounded spin on the overflow ring before the record is counted as dropped
+const int OVERFLOW_LOCK_SPINS = 1024;
+
+// Shared resources: the daemon's registries and the channels this process registered in them
+const char* const REGISTRY_NAMES[CHANNEL_COUNT] = {SHARED_MEMORY_FILEIO_NAME, SHARED_MEMORY_MEMMGMT_NAME};
+ChannelRegistry* channel_registries[CHANNEL_COUNT] = {nullptr, nullptr};
+size_t registry_sizes[CHANNEL_COUNT] = {0, 0};
+ChannelEntry* channel_entries[CHANNEL_COUNT] = {nullptr, nullptr};
+SharedMemoryHeader* shared_memory_headers[CHANNEL_COUNT] = {nullptr, nullptr};
+size_t shared_memory_sizes[CHANNEL_COUNT] = {0, 0};
+RawClockReader raw_clock_readers[CHANNEL_COUNT] = {readMonotonicClock, readMonotonicClock};
+char process_name[PATH_MAX] = "";
+pthread_key_t thread_rings_key;
+
+// Ring slots claimed by the current thread, one per channel
+struct ThreadRings {
+    RingSlot* slots[CHANNEL_COUNT];
+    pid_t tid;
+};
+__attribute__((tls_model("initial-exec"))) thread_local ThreadRings thread_rings = {{nullptr, nullptr}, 0};
+
+// Reentrancy guards. Initial-exec TLS is reachable without __tls_get_addr, which may allocate.
+// in_interceptor is set while an event is logged, so allocations made underneath are passed through
+// unlogged; resolving_symbols is set while dlsym runs, allocations are then served by the bootstrap arena.
+__attribute__((tls_model("initial-exec"))) thread_local bool in_interceptor = false;
+__attribute__((tls_model("initial-exec"))) thread_local bool resolving_symbols = false;
+
+// Stack of the thread, bounding the frame pointer walk of captureCallStack
+struct StackBounds {
+    uintptr_t low;
+    uintptr_t high;
+    bool resolved;
+};
+__attribute__((tls_model("initial-exec"))) thread_local StackBounds stack_bounds = {0, 0, false};
+
+const size_t BOOTSTRAP_ARENA_SIZE = 64 * 1024;
+BootstrapArena<BOOTSTRAP_ARENA_SIZE> bootstrap_arena;
+
+// Runtime filters, parsed once from LIBCLOG_FILTER or the file named by LIBCLOG_CONFIG.
+// Directives are separated by ';' or newlines:
+//   ops=open,read,...      operations to log (default all)
+//   path=/var/log/*        path prefix, or glob when it contains *?[ (repeatable)
+//   fd=3,7                 descriptors traced regardless of the path filters
+//   min_io=4096            smallest read / write count logged
+//   min_alloc=1024         smallest allocation size logged
+//   min_latency=100        only log calls that took at least N microseconds
+//   sample=malloc:100      log 1 call in N for an operation
+//   rate=free:10000        log at most N calls per second and thread for an operation
+//   mode=aggregate         keep per-operation counters and histograms instead of logging events
+//   stack=4                attach up to N return addresses of the caller to allocation events
+const size_t MAX_PATH_FILTERS = 16;
+const size_t MAX_PATH_FILTER_LENGTH = 256;
+const size_t MAX_TRACKED_FDS = 65536;
+const size_t FILTER_CONFIG_SIZE = 4096;
+
+struct FilterConfig {
+    uint64_t operation_mask;
+    bool fd_filter_enabled;  // Set by path= or fd=, only descriptors in traced_fds are logged
+    size_t path_filter_count;
+    char path_filters[MAX_PATH_FILTERS][MAX_PATH_FILTER_LENGTH];
+    bool path_filter_is_glob[MAX_PATH_FILTERS];
+    uint64_t min_io_size;
+    uint64_t min_alloc_size;
+    uint64_t min_latency_us;
+    uint32_t sample_every[OP_COUNT];
+    uint32_t sample_rate[OP_COUNT];
+    uint64_t sampled_mask;
+    bool aggregate;
+    uint32_t stack_depth;
+};
+FilterConfig filter_config = {~0ull, false, 0, {}, {}, 0, 0, 0, {}, {}, 0, false, 0};
+
+// Caller frames further apart than this are taken as a register reused by code built without frame pointers
+const uintptr_t MAX_STACK_FRAME_SIZE = 64 * 1024;
+
+// min_latency converted to the raw clock of each channel
+uint64_t min_latency_ticks[CHANNEL_COUNT] = {0, 0};
+
+// Bit set when the descriptor was opened on a path that passed the path filters
+std::atomic<uint64_t> traced_fds[MAX_TRACKED_FDS / 64];
+
+// Path cache: descriptors map to interned path ids, set by open and dup and cleared by close.
+// Descriptors opened before the library was loaded, or by calls it does not intercept, are
+// resolved through /proc/self/fd on their first logged event. Paths are interned without locks
+// into an open-addressing table whose slot index is the path id, with the strings in a bump arena.
+// Each id is announced once per ring, ahead of the first event in that ring that refers to it, so the
+// daemon knows the path whichever ring it drains first; a child after fork announces its ids again.
+// Lookups probe at most MAX_PATH_PROBES slots. Once the table holds MAX_INTERNED_PATHS paths or the
+// arena is exhausted it is marked full and new paths get NO_PATH right away; each such lookup is
+// counted in the fileio channel header for the daemon to report.
+const size_t PATH_ARENA_SIZE = 1 << 20;
+const int PATH_PUBLISH_SPINS = 1024;
+const uint32_t MAX_PATH_PROBES = 64;
+const uint32_t MAX_INTERNED_PATHS = PATH_TABLE_SIZE / 4 * 3;
+const int NO_DESCRIPTOR = -1;
+
+struct PathSlot {
+    std::atomic<uint64_t> hash;     // 0 marks an empty slot
+    std::atomic<const char*> path;  // Published once the string is copied into the arena
+    uint32_t length;
+};
+PathSlot path_table[PATH_TABLE_SIZE];
+char path_arena[PATH_ARENA_SIZE];
+std::atomic<size_t> path_arena_offset(0);
+std::atomic<uint32_t> interned_path_count(0);
+std::atomic<bool> path_table_full(false);
+std::atomic<uint32_t> descriptor_paths[MAX_TRACKED_FDS];
+const size_t ANNOUNCED_PATH_WORDS = PATH_TABLE_SIZE / 64;
+uint64_t* announced_paths[CHANNEL_COUNT] = {nullptr, nullptr};  // ANNOUNCED_PATH_WORDS per ring
+
+// Sampling window of one operation in the current thread
+struct SamplingState {
+    uint64_t window_start;
+    uint32_t countdown;
+    uint32_t seen;
+    uint32_t logged;
+};
+__attribute__((tls_model("initial-exec"))) thread_local SamplingState sampling_states[OP_COUNT];
+
+// Aggregation mode: threads count into their own counters and merge them into the process
+// summary in shared memory at most every SUMMARY_FLUSH_DIVISOR-th of a second and at thread exit
+const uint64_t SUMMARY_FLUSH_DIVISOR = 10;
+ProcessSummary* process_summaries[CHANNEL_COUNT] = {nullptr, nullptr};
+
+struct alignas(CACHE_LINE_SIZE) ThreadSummary {
+    SummaryCounters<uint64_t> counters;
+    uint64_t flushed_at;
+    bool dirty;
+};
+__attribute__((tls_model("initial-exec"))) thread_local ThreadSummary thread_summaries[CHANNEL_COUNT];
+
+// libc functions behind the hand-written wrappers below
+#define LIBC_FUNCTIONS(X) \
+    X(open) \
+    X(open64) \
+    X(openat) \
+    X(openat64) \
+    X(close) \
+    X(dup) \
+    X(dup2) \
+    X(dup3) \
+    X(fopen) \
+    X(fopen64) \
+    X(fclose) \
+    X(malloc) \
+    X(calloc) \
+    X(realloc) \
+    X(free) \
+    X(posix_memalign) \
+    X(aligned_alloc) \
+    X(memalign) \
+    X(valloc)
+
+// Wrappers generated by DEFINE_TRACED_WRAPPER, one line per function:
+// X(name, channel, opcode, return type, parameters, call arguments, condition, descriptor, logged arguments).
+// condition is evaluated after the call and decides whether the event is logged; the path of
+// descriptor goes with the event, NO_DESCRIPTOR for calls without one.
+#define TRACED_FUNCTIONS(X) \
+    X(lseek,     CHANNEL_FILEIO,  OP_LSEEK,     off_t,   (int fd, off_t offset, int whence), (fd, offset, whence), isFdTraced(fd), fd, (fd, offset, whence)) \
+    X(lseek64,   CHANNEL_FILEIO,  OP_LSEEK,     off64_t, (int fd, off64_t offset, int whence), (fd, offset, whence), isFdTraced(fd), fd, (fd, offset, whence)) \
+    X(read,      CHANNEL_FILEIO,  OP_READ,      ssize_t, (int fd, void* buffer, size_t count), (fd, buffer, count), isIoTraced(fd, count), fd, (fd, buffer, count)) \
+    X(write,     CHANNEL_FILEIO,  OP_WRITE,     ssize_t, (int fd, const void* buffer, size_t count), (fd, buffer, count), isIoTraced(fd, count), fd, (fd, buffer, count)) \
+    X(pread,     CHANNEL_FILEIO,  OP_PREAD,     ssize_t, (int fd, void* buffer, size_t count, off_t offset), (fd, buffer, count, offset), isIoTraced(fd, count), fd, (fd, buffer, count, offset)) \
+    X(pread64,   CHANNEL_FILEIO,  OP_PREAD,     ssize_t, (int fd, void* buffer, size_t count, off64_t offset), (fd, buffer, count, offset), isIoTraced(fd, count), fd, (fd, buffer, count, offset)) \
+    X(pwrite,    CHANNEL_FILEIO,  OP_PWRITE,    ssize_t, (int fd, const void* buffer, size_t count, off_t offset), (fd, buffer, count, offset), isIoTraced(fd, count), fd, (fd, buffer, count, offset)) \
+    X(pwrite64,  CHANNEL_FILEIO,  OP_PWRITE,    ssize_t, (int fd, const void* buffer, size_t count, off64_t offset), (fd, buffer, count, offset), isIoTraced(fd, count), fd, (fd, buffer, count, offset)) \
+    X(readv,     CHANNEL_FILEIO,  OP_READV,     ssize_t, (int fd, const struct iovec* iov, int iovcnt), (fd, iov, iovcnt), isIoTraced(fd, iovecBytes(iov, iovcnt)), fd, (fd, iov, iovcnt)) \
+    X(writev,    CHANNEL_FILEIO,  OP_WRITEV,    ssize_t, (int fd, const struct iovec* iov, int iovcnt), (fd, iov, iovcnt), isIoTraced(fd, iovecBytes(iov, iovcnt)), fd, (fd, iov, iovcnt)) \
+    X(fsync,     CHANNEL_FILEIO,  OP_FSYNC,     int,     (int fd), (fd), isFdTraced(fd), fd, (fd)) \
+    X(fdatasync, CHANNEL_FILEIO,  OP_FDATASYNC, int,     (int fd), (fd), isFdTraced(fd), fd, (fd)) \
+    X(sendfile,  CHANNEL_FILEIO,  OP_SENDFILE,  ssize_t, (int out_fd, int in_fd, off_t* offset, size_t count), (out_fd, in_fd, offset, count), isIoTraced(out_fd, count) || isIoTraced(in_fd, count), in_fd, (out_fd, in_fd, offset, count)) \
+    X(sendfile64, CHANNEL_FILEIO, OP_SENDFILE,  ssize_t, (int out_fd, int in_fd, off64_t* offset, size_t count), (out_fd, in_fd, offset, count), isIoTraced(out_fd, count) || isIoTraced(in_fd, count), in_fd, (out_fd, in_fd, offset, count)) \
+    X(fread,     CHANNEL_FILEIO,  OP_FREAD,     size_t,  (void* buffer, size_t size, size_t count, FILE* stream), (buffer, size, count, stream), isIoTraced(fileno_unlocked(stream), size * count), fileno_unlocked(stream), (fileno_unlocked(stream), buffer, size, count)) \
+    X(fwrite,    CHANNEL_FILEIO,  OP_FWRITE,    size_t,  (const void* buffer, size_t size, size_t count, FILE* stream), (buffer, size, count, stream), isIoTraced(fileno_unlocked(stream), size * count), fileno_unlocked(stream), (fileno_unlocked(stream), buffer, size, count)) \
+    X(mmap,      CHANNEL_MEMMGMT, OP_MMAP,      void*,   (void* address, size_t length, int prot, int flags, int fd, off_t offset), (address, length, prot, flags, fd, offset), length >= filter_config.min_alloc_size, NO_DESCRIPTOR, (address, length, prot, flags, fd, offset)) \
+    X(mmap64,    CHANNEL_MEMMGMT, OP_MMAP,      void*,   (void* address, size_t length, int prot, int flags, int fd, off64_t offset), (address, length, prot, flags, fd, offset), length >= filter_config.min_alloc_size, NO_DESCRIPTOR, (address, length, prot, flags, fd, offset)) \
+    X(munmap,    CHANNEL_MEMMGMT, OP_MUNMAP,    int,     (void* address, size_t length), (address, length), length >= filter_config.min_alloc_size, NO_DESCRIPTOR, (address, length))
+
+// Pointers to the real functions, typed after their declarations in the libc headers
+#define DECLARE_LIBC_FUNCTION(name, ...) decltype(&::name) libc_##name = nullptr;
+LIBC_FUNCTIONS(DECLARE_LIBC_FUNCTION)
+TRACED_FUNCTIONS(DECLARE_LIBC_FUNCTION)
+#undef DECLARE_LIBC_FUNCTION
+std::atomic<bool> libc_resolved(false);
+
+void handleError(bool condition, const char* error_message) {
+    if (condition) {
+        perror(error_message);
+        exit(EXIT_FAILURE);
+    }
+}
+
+void resolveLibcFunctions() {
+    resolving_symbols = true;
+    // Load libc function pointers (dlopen + Lazy = crash)
+    bool missing = false;
+#define RESOLVE_LIBC_FUNCTION(name, ...) \
+    libc_##name = reinterpret_cast<decltype(libc_##name)>(dlsym(RTLD_NEXT, #name)); \
+    missing = missing || libc_##name == nullptr;
+    LIBC_FUNCTIONS(RESOLVE_LIBC_FUNCTION)
+    TRACED_FUNCTIONS(RESOLVE_LIBC_FUNCTION)
+#undef RESOLVE_LIBC_FUNCTION
+    resolving_symbols = false;
+    handleError(missing, "Failed to load libc functions");
+    libc_resolved.store(true, std::memory_order_release);
+}
+
+// Allocator calls may arrive before the constructor; returns false while dlsym itself is allocating
+bool ensureAllocatorResolved() {
+    if (libc_resolved.load(std::memory_order_acquire)) {
+        return true;
+    }
+    if (resolving_symbols) {
+        return false;
+    }
+    resolveLibcFunctions();
+    return true;
+}
+
+// Other wrappers may also run before the constructor, from constructors of other libraries
+inline void ensureLibcResolved() {
+    if (__builtin_expect(!libc_resolved.load(std::memory_order_acquire), 0)) {
+        handleError(resolving_symbols, "LibCLog wrapper called while resolving libc functions");
+        resolveLibcFunctions();
+    }
+}
+
+inline bool isOperationEnabled(EventOpcode opcode) {
+    return (filter_config.operation_mask >> opcode) & 1u;
+}
+
+inline bool isFdTraced(int fd) {
+    if (!filter_config.fd_filter_enabled) {
+        return true;
+    }
+    return fd >= 0 && static_cast<size_t>(fd) < MAX_TRACKED_FDS &&
+           (traced_fds[fd / 64].load(std::memory_order_relaxed) >> (fd % 64)) & 1u;
+}
+
+inline bool isIoTraced(int fd, size_t count) {
+    return count >= filter_config.min_io_size && isFdTraced(fd);
+}
+
+inline size_t iovecBytes(const struct iovec* iov, int iovcnt) {
+    size_t bytes = 0;
+    for (int index = 0; index < iovcnt; ++index) {
+        bytes += iov[index].iov_len;
+    }
+    return bytes;
+}
+
+void setFdTraced(int fd, bool traced) {
+    if (!filter_config.fd_filter_enabled || fd < 0 || static_cast<size_t>(fd) >= MAX_TRACKED_FDS) {
+        return;
+    }
+    uint64_t bit = 1ull << (fd % 64);
+    if (traced) {
+        traced_fds[fd / 64].fetch_or(bit, std::memory_order_relaxed);
+    } else {
+        traced_fds[fd / 64].fetch_and(~bit, std::memory_order_relaxed);
+    }
+}
+
+// Wait for the thread that claimed a slot to publish its string, nullptr if it takes too long
+const char* publishedPath(const PathSlot& slot) {
+    for (int spin = 0; spin < PATH_PUBLISH_SPINS; ++spin) {
+        const char* path = slot.path.load(std::memory_order_acquire);
+        if (path != nullptr) {
+            return path;
+        }
+    }
+    return nullptr;
+}
+
+uint32_t uninternedPath() {
+    SharedMemoryHeader* header = shared_memory_headers[CHANNEL_FILEIO];
+    if (header != nullptr) {
+        header->uninterned_paths.fetch_add(1, std::memory_order_relaxed);
+    }
+    return NO_PATH;
+}
+
+// Path id of the string, interned on first use; NO_PATH once the table or the arena is full
+uint32_t internPath(const char* path, uint32_t length) {
+    if (path_table_full.load(std::memory_order_relaxed)) {
+        return uninternedPath();
+    }
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (uint32_t index = 0; index < length; ++index) {
+        hash = (hash ^ static_cast<uint8_t>(path[index])) * 0x100000001b3ull;
+    }
+    hash |= 1;
+    uint32_t mask = PATH_TABLE_SIZE - 1;
+    uint32_t index = static_cast<uint32_t>(hash >> 32) & mask;
+    for (uint32_t probe = 0; probe < MAX_PATH_PROBES; ++probe, index = (index + 1) & mask) {
+        if (index == NO_PATH) {
+            continue;
+        }
+        PathSlot& slot = path_table[index];
+        uint64_t slot_hash = slot.hash.load(std::memory_order_acquire);
+        if (slot_hash == 0) {
+            if (interned_path_count.load(std::memory_order_relaxed) >= MAX_INTERNED_PATHS) {
+                path_table_full.store(true, std::memory_order_relaxed);
+                return uninternedPath();
+            }
+            // The arena space is only reserved by the winner; a loser compares against the winner's path
+            if (slot.hash.compare_exchange_strong(slot_hash, hash, std::memory_order_acq_rel)) {
+                interned_path_count.fetch_add(1, std::memory_order_relaxed);
+                size_t offset = path_arena_offset.fetch_add(length, std::memory_order_relaxed);
+                if (offset + length > PATH_ARENA_SIZE) {
+                    // The slot stays claimed, with a length no path has
+                    path_table_full.store(true, std::memory_order_relaxed);
+                    slot.length = UINT32_MAX;
+                    slot.path.store(path_arena, std::memory_order_release);
+                    return uninternedPath();
+                }
+                memcpy(path_arena + offset, path, length);
+                slot.length = length;
+                slot.path.store(path_arena + offset, std::memory_order_release);
+                return index;
+            }
+        }
+        if (slot_hash == hash) {
+            const char* stored = publishedPath(slot);
+            if (stored == nullptr) {
+                return uninternedPath();
+            }
+            if (slot.length == length && memcmp(stored, path, length) == 0) {
+                return index;
+            }
+        }
+    }
+    return uninternedPath();
+}
+
+void setDescriptorPath(int fd, uint32_t path) {
+    if (fd >= 0 && static_cast<size_t>(fd) < MAX_TRACKED_FDS) {
+        descriptor_paths[fd].store(path, std::memory_order_relaxed);
+    }
+}
+
+// Path id of a descriptor, read from /proc/self/fd the first time an unknown descriptor is logged
+uint32_t descriptorPath(int fd) {
+    if (fd < 0 || static_cast<size_t>(fd) >= MAX_TRACKED_FDS) {
+        return NO_PATH;
+    }
+    uint32_t path = descriptor_paths[fd].load(std::memory_order_relaxed);
+    if (path != NO_PATH) {
+        return path;
+    }
+    char link[32] = "/proc/self/fd/";
+    char digits[12];
+    int digit_count = 0;
+    for (unsigned value = static_cast<unsigned>(fd); digit_count == 0 || value != 0; value /= 10) {
+        digits[digit_count++] = static_cast<char>('0' + value % 10);
+    }
+    size_t link_length = strlen(link);
+    while (digit_count != 0) {
+        link[link_length++] = digits[--digit_count];
+    }
+    link[link_length] = '\0';
+    char target[PATH_MAX];
+    ssize_t length = readlink(link, target, sizeof(target));
+    if (length <= 0) {
+        return NO_PATH;
+    }
+    path = internPath(target, std::min<uint32_t>(static_cast<uint32_t>(length), MAX_EVENT_STRING_LENGTH));
+    // A descriptor opened meanwhile by another thread keeps the path its open set
+    uint32_t expected = NO_PATH;
+    descriptor_paths[fd].compare_exchange_strong(expected, path, std::memory_order_relaxed);
+    return expected == NO_PATH ? path : expected;
+}
+
+// Duplicates refer to the same file as the original descriptor
+void copyDescriptor(int fd, int new_fd) {
+    if (new_fd < 0 || new_fd == fd) {
+        return;
+    }
+    setFdTraced(new_fd, isFdTraced(fd));
+    setDescriptorPath(new_fd, fd >= 0 && static_cast<size_t>(fd) < MAX_TRACKED_FDS
+                                  ? descriptor_paths[fd].load(std::memory_order_relaxed) : NO_PATH);
+}
+
+bool matchesPathFilters(const char* path) {
+    if (!filter_config.fd_filter_enabled) {
+        return true;
+    }
+    for (size_t index = 0; index < filter_config.path_filter_count; ++index) {
+        const char* pattern = filter_config.path_filters[index];
+        if (filter_config.path_filter_is_glob[index] ? fnmatch(pattern, path, 0) == 0
+                                                     : strncmp(pattern, path, strlen(pattern)) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int findOpcode(const char* name, size_t length) {
+    for (int opcode = OP_OPEN; opcode < OP_COUNT; ++opcode) {
+        if (opcode != OP_SAMPLING && opcode != OP_PATH && strlen(EVENT_OPCODE_NAMES[opcode]) == length && strncmp(EVENT_OPCODE_NAMES[opcode], name, length) == 0) {
+            return opcode;
+        }
+    }
+    return -1;
+}
+
+// Parse "op:N" for sample= and rate= into the per-operation table
+void parseOperationValues(const char* value, uint32_t* table) {
+    while (*value != '\0') {
+        size_t length = strcspn(value, ",");
+        const char* separator = static_cast<const char*>(memchr(value, ':', length));
+        int opcode = separator != nullptr ? findOpcode(value, separator - value) : -1;
+        handleError(opcode == -1, "Invalid LibCLog sampling filter");
+        table[opcode] = static_cast<uint32_t>(strtoul(separator + 1, nullptr, 10));
+        value += length + (value[length] == ',' ? 1 : 0);
+    }
+}
+
+void parseFilterDirective(char* directive) {
+    char* value = strchr(directive, '=');
+    if (value == nullptr) {
+        handleError(directive[strspn(directive, " \t")] != '\0', "Invalid LibCLog filter directive");
+        return;
+    }
+    *value++ = '\0';
+    if (strcmp(directive, "ops") == 0) {
+        filter_config.operation_mask = 1ull << OP_SAMPLING;
+        while (*value != '\0') {
+            size_t length = strcspn(value, ",");
+            int opcode = findOpcode(value, length);
+            handleError(opcode == -1, "Invalid LibCLog operation filter");
+            filter_config.operation_mask |= 1ull << opcode;
+            value += length + (value[length] == ',' ? 1 : 0);
+        }
+    } else if (strcmp(directive, "path") == 0) {
+        handleError(filter_config.path_filter_count == MAX_PATH_FILTERS || strlen(value) >= MAX_PATH_FILTER_LENGTH,
+                    "Too many or too long LibCLog path filters");
+        size_t index = filter_config.path_filter_count++;
+        strcpy(filter_config.path_filters[index], value);
+        filter_config.path_filter_is_glob[index] = strpbrk(value, "*?[") != nullptr;
+        filter_config.fd_filter_enabled = true;
+    } else if (strcmp(directive, "fd") == 0) {
+        filter_config.fd_filter_enabled = true;
+        for (char* fd = value; *fd != '\0'; fd += strcspn(fd, ",") + (fd[strcspn(fd, ",")] == ',' ? 1 : 0)) {
+            setFdTraced(static_cast<int>(strtol(fd, nullptr, 10)), true);
+        }
+    } else if (strcmp(directive, "min_io") == 0) {
+        filter_config.min_io_size = strtoull(value, nullptr, 10);
+    } else if (strcmp(directive, "min_alloc") == 0) {
+        filter_config.min_alloc_size = strtoull(value, nullptr, 10);
+    } else if (strcmp(directive, "min_latency") == 0) {
+        filter_config.min_latency_us = strtoull(value, nullptr, 10);
+    } else if (strcmp(directive, "sample") == 0) {
+        parseOperationValues(value, filter_config.sample_every);
+    } else if (strcmp(directive, "rate") == 0) {
+        parseOperationValues(value, filter_config.sample_rate);
+    } else if (strcmp(directive, "mode") == 0) {
+        handleError(strcmp(value, "aggregate") != 0 && strcmp(value, "trace") != 0, "Invalid LibCLog mode");
+        filter_config.aggregate = strcmp(value, "aggregate") == 0;
+    } else if (strcmp(directive, "stack") == 0) {
+        filter_config.stack_depth = std::min<uint32_t>(static_cast<uint32_t>(strtoul(value, nullptr, 10)), MAX_CALL_STACK_DEPTH);
+    } else {
+        handleError(true, "Unknown LibCLog filter directive");
+    }
+}
+
+// Read the filter from the environment or the config file, without going through the wrappers
+void initializeFilters() {
+    static char config[FILTER_CONFIG_SIZE];
+    const char* filter = getenv("LIBCLOG_FILTER");
+    const char* config_path = getenv("LIBCLOG_CONFIG");
+    if (filter != nullptr) {
+        strncpy(config, filter, sizeof(config) - 1);
+    } else if (config_path != nullptr) {
+        int config_fd = libc_open(config_path, O_RDONLY | O_CLOEXEC);
+        handleError(config_fd == -1, "Failed to open LibCLog config");
+        ssize_t length = libc_read(config_fd, config, sizeof(config) - 1);
+        libc_close(config_fd);
+        handleError(length == -1, "Failed to read LibCLog config");
+        config[length] = '\0';
+    } else {
+        return;
+    }
+
+    char* save_pointer = nullptr;
+    for (char* directive = strtok_r(config, ";\n", &save_pointer); directive != nullptr;
+         directive = strtok_r(nullptr, ";\n", &save_pointer)) {
+        parseFilterDirective(directive);
+    }
+    for (int opcode = 0; opcode < OP_COUNT; ++opcode) {
+        if (filter_config.sample_every[opcode] > 1 || filter_config.sample_rate[opcode] != 0) {
+            filter_config.sampled_mask |= 1ull << opcode;
+        }
+    }
+}
+
+// Filled by the constructor, which runs before dynamic initializers of this library
+void getCurrentProcessName() {
+    if (process_name[0] == '\0') {
+        ssize_t len = readlink("/proc/self/exe", process_name, sizeof(process_name) - 1);
+        handleError(len <= 0, "Failed to read exe link");
+        process_name[len] = '\0';
+    }
+}
+
+// Map the registry the daemon created for a channel
+void initializeRegistry(Channel channel) {
+    int registry_fd = shm_open(REGISTRY_NAMES[channel], O_RDWR, 0666);
+    handleError(registry_fd == -1, "Failed to open shared memory");
+    struct stat registry_stat;
+    handleError(fstat(registry_fd, &registry_stat) == -1, "Failed to stat shared memory");
+    size_t size = registry_stat.st_size;
+    handleError(size < sizeof(ChannelRegistry), "Shared memory is not initialized by the daemon");
+    void* mapping = libc_mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, registry_fd, 0);
+    handleError(mapping == MAP_FAILED, "Failed to map shared memory");
+    libc_close(registry_fd);
+
+    ChannelRegistry* registry = static_cast<ChannelRegistry*>(mapping);
+    handleError(registry->magic.load(std::memory_order_acquire) != SHARED_MEMORY_MAGIC ||
+                registry->version != SHARED_MEMORY_VERSION || registrySize(registry->channel_count) > size,
+                "Shared memory layout mismatch");
+    raw_clock_readers[channel] = rawClockReader(registry->clock_source);
+    channel_registries[channel] = registry;
+    registry_sizes[channel] = size;
+}
+
+// Tell the daemon the entry changed state
+void announceChannel(ChannelRegistry* registry) {
+    registry->generation.fetch_add(1, std::memory_order_release);
+    ringDoorbell(registry);
+}
+
+// Hand the channel back, the daemon drains what is left in its rings and frees the entry
+void closeChannel(Channel channel) {
+    ChannelEntry* entry = channel_entries[channel];
+    channel_entries[channel] = nullptr;
+    uint32_t expected = CHANNEL_ACTIVE;
+    if (entry != nullptr && entry->state.compare_exchange_strong(expected, CHANNEL_CLOSED, std::memory_order_release,
+                                                                 std::memory_order_relaxed)) {
+        announceChannel(channel_registries[channel]);
+    }
+}
+
+// Close the entries the process registered before an exec replaced its image
+void closeStaleChannels(ChannelRegistry* registry, uint32_t pid) {
+    for (uint32_t index = 0; index < registry->channel_count; ++index) {
+        ChannelEntry* entry = channelEntry(registry, index);
+        uint32_t state = entry->state.load(std::memory_order_acquire);
+        if ((state == CHANNEL_CLAIMED || state == CHANNEL_ACTIVE) && entry->pid.load(std::memory_order_relaxed) == pid &&
+            entry->state.compare_exchange_strong(state, CHANNEL_CLOSED, std::memory_order_release, std::memory_order_relaxed)) {
+            announceChannel(registry);
+        }
+    }
+}
+
+// Create the process's own channel segment and activate it in a free registry entry.
+// Without a free entry the process logs nothing on the channel and is counted as rejected.
+void registerChannel(Channel channel) {
+    ChannelRegistry* registry = channel_registries[channel];
+    uint32_t pid = static_cast<uint32_t>(getpid());
+    closeStaleChannels(registry, pid);
+
+    ChannelEntry* entry = nullptr;
+    uint32_t entry_index = 0;
+    for (uint32_t index = 0; index < registry->channel_count && entry == nullptr; ++index) {
+        ChannelEntry* candidate = channelEntry(registry, index);
+        uint32_t expected = CHANNEL_FREE;
+        if (candidate->state.load(std::memory_order_relaxed) == CHANNEL_FREE &&
+            candidate->state.compare_exchange_strong(expected, CHANNEL_CLAIMED, std::memory_order_acquire,
+                                                     std::memory_order_relaxed)) {
+            candidate->pid.store(pid, std::memory_order_relaxed);
+            entry = candidate;
+            entry_index = index;
+        }
+    }
+    if (entry == nullptr) {
+        registry->rejected.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    char segment_name[CHANNEL_NAME_SIZE];
+    channelSegmentName(segment_name, sizeof(segment_name), REGISTRY_NAMES[channel], pid, entry_index);
+    size_t size = sharedMemorySize(registry->ring_count, registry->ring_size);
+    int segment_fd = shm_open(segment_name, O_RDWR | O_CREAT, 0666);
+    handleError(segment_fd == -1, "Failed to create channel shared memory");
+    handleError(ftruncate(segment_fd, 0) == -1 || ftruncate(segment_fd, size) == -1,
+                "Failed to set size of channel shared memory");
+    void* mapping = libc_mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, segment_fd, 0);
+    handleError(mapping == MAP_FAILED, "Failed to map channel shared memory");
+    libc_close(segment_fd);
+
+    // The daemon reads the header once it sees the entry active, so the clock and geometry are copied
+    // here and the hot path never touches the registry
+    SharedMemoryHeader* header = static_cast<SharedMemoryHeader*>(mapping);
+    header->version = SHARED_MEMORY_VERSION;
+    header->pid = pid;
+    header->ring_count = registry->ring_count;
+    header->ring_size = registry->ring_size;
+    header->clock_source = registry->clock_source;
+    header->high_water_mark = registry->high_water_mark;
+    header->frees_complete = !filter_config.aggregate && filter_config.min_latency_us == 0 &&
+                             isOperationEnabled(OP_FREE) && isOperationEnabled(OP_REALLOC) &&
+                             (filter_config.sampled_mask & ((1ull << OP_FREE) | (1ull << OP_REALLOC))) == 0;
+    header->clock_anchor = registry->clock_anchor;
+    snprintf(header->process_name, sizeof(header->process_name), "%s", process_name);
+    header->magic.store(SHARED_MEMORY_MAGIC, std::memory_order_release);
+    if (filter_config.aggregate) {
+        processSummary(header)->published.store(1, std::memory_order_release);
+    }
+
+    // Private to the process, written only by the producer of each ring
+    void* announced = libc_mmap(nullptr, registry->ring_count * ANNOUNCED_PATH_WORDS * sizeof(uint64_t),
+                                PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    handleError(announced == MAP_FAILED, "Failed to map announced paths");
+    announced_paths[channel] = static_cast<uint64_t*>(announced);
+
+    shared_memory_headers[channel] = header;
+    shared_memory_sizes[channel] = size;
+    channel_entries[channel] = entry;
+    entry->state.store(CHANNEL_ACTIVE, std::memory_order_release);
+    announceChannel(registry);
+}
+
+void registerChannels() {
+    // shm_open may go through the open wrapper, which must not log into a half-built channel
+    in_interceptor = true;
+    for (int channel = 0; channel < CHANNEL_COUNT; ++channel) {
+        registerChannel(static_cast<Channel>(channel));
+        process_summaries[channel] = shared_memory_headers[channel] != nullptr && filter_config.aggregate
+                                         ? processSummary(shared_memory_headers[channel]) : nullptr;
+    }
+    in_interceptor = false;
+}
+
+// Add the thread's counters to the process summary of the channel
+void flushThreadSummary(Channel channel) {
+    ThreadSummary& thread_summary = thread_summaries[channel];
+    ProcessSummary* summary = process_summaries[channel];
+    if (!thread_summary.dirty) {
+        return;
+    }
+    if (summary != nullptr) {
+        static_assert(sizeof(SummaryCounters<uint64_t>) == sizeof(SummaryCounters<std::atomic<uint64_t>>),
+                      "Summary counters must have the same layout in both forms");
+        const uint64_t* source = reinterpret_cast<const uint64_t*>(&thread_summary.counters);
+        std::atomic<uint64_t>* target = reinterpret_cast<std::atomic<uint64_t>*>(&summary->counters);
+        for (size_t index = 0; index < sizeof(thread_summary.counters) / sizeof(uint64_t); ++index) {
+            if (source[index] != 0) {
+                target[index].fetch_add(source[index], std::memory_order_relaxed);
+            }
+        }
+    }
+    memset(&thread_summary.counters, 0, sizeof(thread_summary.counters));
+    thread_summary.dirty = false;
+}
+
+// The destructor runs for every thread that logged an event or counted one
+void registerThread() {
+    if (thread_rings.tid == 0) {
+        thread_rings.tid = static_cast<pid_t>(syscall(SYS_gettid));
+        pthread_setspecific(thread_rings_key, &thread_rings);
+    }
+}
+
+// Give the thread's ring slots back and flush its counters when it exits
+void releaseThreadRings(void*) {
+    for (int channel = 0; channel < CHANNEL_COUNT; ++channel) {
+        flushThreadSummary(static_cast<Channel>(channel));
+        SharedMemoryHeader* header = shared_memory_headers[channel];
+        if (header == nullptr) {
+            thread_rings.slots[channel] = nullptr;
+            continue;
+        }
+        RingSlot* slot = thread_rings.slots[channel];
+        if (slot != nullptr && slot != ringSlot(header, OVERFLOW_RING_INDEX)) {
+            slot->owner_tid.store(0, std::memory_order_release);
+        }
+        // Allocations made later in the thread teardown go to the overflow ring instead of claiming a new slot
+        thread_rings.slots[channel] = ringSlot(header, OVERFLOW_RING_INDEX);
+    }
+}
+
+// The child of fork() only inherits the forking thread; the channels, slots and unflushed counts
+// still belong to the parent, so the child drops its view of them and registers channels of its own
+void resetThreadRingsInChild() {
+    for (int channel = 0; channel < CHANNEL_COUNT; ++channel) {
+        thread_rings.slots[channel] = nullptr;
+        memset(&thread_summaries[channel], 0, sizeof(thread_summaries[channel]));
+        SharedMemoryHeader* header = shared_memory_headers[channel];
+        shared_memory_headers[channel] = nullptr;
+        process_summaries[channel] = nullptr;
+        channel_entries[channel] = nullptr;
+        if (header != nullptr) {
+            libc_munmap(announced_paths[channel], header->ring_count * ANNOUNCED_PATH_WORDS * sizeof(uint64_t));
+            libc_munmap(header, shared_memory_sizes[channel]);
+        }
+        announced_paths[channel] = nullptr;
+    }
+    thread_rings.tid = 0;
+    registerChannels();
+}
+
+RingSlot* claimRingSlot(SharedMemoryHeader* header) {
+    registerThread();
+    uint32_t tid = static_cast<uint32_t>(thread_rings.tid);
+    uint32_t claimable = header->ring_count - 1;
+    for (uint32_t attempt = 0; attempt < claimable; ++attempt) {
+        uint32_t index = 1 + (tid + attempt) % claimable;
+        RingSlot* slot = ringSlot(header, index);
+        uint32_t expected = 0;
+        if (slot->owner_tid.load(std::memory_order_relaxed) == 0 &&
+            slot->owner_tid.compare_exchange_strong(expected, tid, std::memory_order_acquire, std::memory_order_relaxed)) {
+            return slot;
+        }
+    }
+    return ringSlot(header, OVERFLOW_RING_INDEX);
+}
+
+// Space reserved in a ring, invisible to the daemon until commitRecord()
+struct RecordReservation {
+    char* payload;
+    uint64_t new_head;
+    uint64_t used_before;
+    uint64_t used_after;
+};
+
+// Reserve space for one length-prefixed record; returns false and counts a drop when the ring is full
+bool reserveRecord(SharedMemoryHeader* header, RingSlot* slot, uint32_t payload_length, RecordReservation& reservation) {
+    uint32_t ring_size = header->ring_size;
+    char* buffer = ringBuffer(header, static_cast<uint32_t>(slot - ringSlot(header, 0)));
+    uint32_t record_length = alignRecordLength(sizeof(RecordHeader) + payload_length);
+    uint64_t head = slot->head.load(std::memory_order_relaxed);
+    uint64_t tail = slot->tail.load(std::memory_order_acquire);
+    uint32_t position = static_cast<uint32_t>(head & (ring_size - 1));
+    uint32_t contiguous = ring_size - position;
+    uint32_t padding = contiguous < record_length ? contiguous : 0;
+    if (record_length > ring_size / 2 || head + padding + record_length - tail > ring_size) {
+        slot->dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    reservation.used_before = head - tail;
+
+    if (padding != 0) {
+        RecordHeader* padding_header = reinterpret_cast<RecordHeader*>(buffer + position);
+        padding_header->length = padding | RECORD_PADDING_FLAG;
+        padding_header->sequence = 0;
+        head += padding;
+        position = 0;
+    }
+    uint32_t sequence = slot->next_sequence.load(std::memory_order_relaxed);
+    slot->next_sequence.store(sequence + 1, std::memory_order_relaxed);
+    RecordHeader* record_header = reinterpret_cast<RecordHeader*>(buffer + position);
+    record_header->length = record_length;
+    record_header->sequence = sequence;
+    reservation.payload = reinterpret_cast<char*>(record_header + 1);
+    reservation.new_head = head + record_length;
+    reservation.used_after = reservation.new_head - tail;
+    return true;
+}
+
+// Publish the reserved record and wake the daemon when the ring just crossed its high-water mark
+void commitRecord(Channel channel, SharedMemoryHeader* header, RingSlot* slot, const RecordReservation& reservation) {
+    slot->head.store(reservation.new_head, std::memory_order_release);
+    if (reservation.used_before < header->high_water_mark && reservation.used_after >= header->high_water_mark) {
+        ChannelRegistry* registry = channel_registries[channel];
+        // Pairs with the fence in the daemon between setting consumer_waiting and rescanning the rings
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (registry->consumer_waiting.load(std::memory_order_relaxed) != 0) {
+            ringDoorbell(registry);
+        }
+    }
+}
+
+bool writeEvent(Channel channel, SharedMemoryHeader* header, RingSlot* slot, EventOpcode opcode, uint64_t timestamp,
+                uint64_t duration, int64_t result, const uint64_t* arguments, uint32_t argument_count, const char* string,
+                uint32_t string_length, uint32_t file) {
+    RecordReservation reservation;
+    if (!reserveRecord(header, slot, eventLength(argument_count, string_length), reservation)) {
+        return false;
+    }
+    EventRecord* event = reinterpret_cast<EventRecord*>(reservation.payload);
+    event->opcode = opcode;
+    event->argument_count = static_cast<uint8_t>(argument_count);
+    event->string_length = static_cast<uint16_t>(string_length);
+    event->tid = static_cast<uint32_t>(thread_rings.tid);
+    event->timestamp = timestamp;
+    event->duration = duration;
+    event->result = result;
+    event->file = file;
+    event->reserved = 0;
+    memcpy(event + 1, arguments, argument_count * sizeof(uint64_t));
+    if (string_length != 0) {
+        memcpy(const_cast<char*>(eventString(event)), string, string_length);
+    }
+    commitRecord(channel, header, slot, reservation);
+    return true;
+}
+
+// Send the path of an id ahead of the first event in this ring that refers to it. The record carries
+// timestamp 0, so the daemon's timestamp sort puts it before the events of its drain cycle. The caller
+// holds the ring, so the ring's bits have a single writer; a thread taking over a released ring keeps
+// its bits, the announcements are already in the ring.
+void announcePath(Channel channel, SharedMemoryHeader* header, RingSlot* slot, uint32_t path) {
+    uint64_t* announced = announced_paths[channel] + (slot - ringSlot(header, 0)) * ANNOUNCED_PATH_WORDS;
+    uint64_t bit = 1ull << (path % 64);
+    if ((announced[path / 64] & bit) != 0) {
+        return;
+    }
+    const PathSlot& path_slot = path_table[path];
+    const uint64_t values[] = {path};
+    if (writeEvent(channel, header, slot, OP_PATH, 0, 0, 0, values, 1, path_slot.path.load(std::memory_order_acquire),
+                   path_slot.length, path)) {
+        announced[path / 64] |= bit;
+    }
+}
+
+// Find the ring of the calling thread, taking the lock when it is the shared overflow ring.
+// Returns nullptr when the overflow ring stays contended, the event is then counted as dropped.
+RingSlot* acquireRing(Channel channel, SharedMemoryHeader* header) {
+    RingSlot*& slot = thread_rings.slots[channel];
+    if (slot == nullptr) {
+        slot = claimRingSlot(header);
+    }
+    RingSlot* overflow_slot = ringSlot(header, OVERFLOW_RING_INDEX);
+    if (slot == overflow_slot) {
+        int spin = 0;
+        while (slot->overflow_lock.exchange(1, std::memory_order_acquire) != 0) {
+            if (++spin == OVERFLOW_LOCK_SPINS) {
+                slot->dropped.fetch_add(1, std::memory_order_relaxed);
+                return nullptr;
+            }
+        }
+    }
+    return slot;
+}
+
+void releaseRing(SharedMemoryHeader* header, RingSlot* slot) {
+    if (slot == ringSlot(header, OVERFLOW_RING_INDEX)) {
+        slot->overflow_lock.store(0, std::memory_order_release);
+    }
+}
+
+template <typename Argument>
+uint64_t eventArgument(Argument argument) {
+    return (uint64_t)argument;
+}
+
+void reportSamplingWindow(Channel channel, SharedMemoryHeader* header, EventOpcode opcode, uint64_t timestamp,
+                          const SamplingState& state) {
+    RingSlot* slot = acquireRing(channel, header);
+    if (slot != nullptr) {
+        const uint64_t values[] = {opcode, state.seen, state.logged, filter_config.sample_every[opcode],
+                                   filter_config.sample_rate[opcode]};
+        writeEvent(channel, header, slot, OP_SAMPLING, timestamp, 0, 0, values, 5, nullptr, 0, NO_PATH);
+        releaseRing(header, slot);
+    }
+}
+
+// Decide whether a sampled call is logged; at the end of each one-second window the counts
+// go to the daemon so it can scale them back up
+bool sampleEvent(Channel channel, SharedMemoryHeader* header, EventOpcode opcode, uint64_t timestamp) {
+    SamplingState& state = sampling_states[opcode];
+    if (timestamp - state.window_start >= header->clock_anchor.ticks_per_second) {
+        if (state.seen != 0) {
+            reportSamplingWindow(channel, header, opcode, timestamp, state);
+        }
+        state.window_start = timestamp;
+        state.seen = 0;
+        state.logged = 0;
+    }
+    uint32_t call = state.seen++;
+    uint32_t every = filter_config.sample_every[opcode];
+    uint32_t rate = filter_config.sample_rate[opcode];
+    if ((every > 1 && call % every != 0) || (rate != 0 && state.logged >= rate)) {
+        return false;
+    }
+    ++state.logged;
+    return true;
+}
+
+// Size counted in the histogram of an operation, 0 for operations without one
+uint64_t eventSize(EventOpcode opcode, int64_t result, const uint64_t* values) {
+    switch (opcode) {
+        case OP_READ:
+        case OP_WRITE:
+        case OP_PREAD:
+        case OP_PWRITE:
+        case OP_READV:
+        case OP_WRITEV:
+        case OP_SENDFILE:
+            return result > 0 ? static_cast<uint64_t>(result) : 0;
+        case OP_FREAD:
+        case OP_FWRITE:
+            return static_cast<uint64_t>(result) * values[2];
+        case OP_MALLOC:
+        case OP_VALLOC:
+            return values[0];
+        case OP_CALLOC:
+            return values[0] * values[1];
+        case OP_REALLOC:
+        case OP_POSIX_MEMALIGN:
+        case OP_ALIGNED_ALLOC:
+        case OP_MEMALIGN:
+        case OP_MMAP:
+        case OP_MUNMAP:
+            return values[1];
+        default:
+            return 0;
+    }
+}
+
+inline bool isReadOperation(EventOpcode opcode) {
+    return opcode == OP_READ || opcode == OP_PREAD || opcode == OP_READV || opcode == OP_FREAD;
+}
+
+inline bool isWriteOperation(EventOpcode opcode) {
+    return opcode == OP_WRITE || opcode == OP_PWRITE || opcode == OP_WRITEV || opcode == OP_FWRITE ||
+           opcode == OP_SENDFILE;
+}
+
+// Descriptors past the summary table share its last entry
+inline uint64_t summaryFd(uint64_t fd) {
+    return std::min<uint64_t>(fd, SUMMARY_FD_COUNT - 1);
+}
+
+// Count one call in the thread's counters instead of writing a record
+void aggregateEvent(Channel channel, SharedMemoryHeader* header, EventOpcode opcode, int64_t result,
+                    const uint64_t* values) {
+    ThreadSummary& thread_summary = thread_summaries[channel];
+    SummaryCounters<uint64_t>& counters = thread_summary.counters;
+    uint64_t size = eventSize(opcode, result, values);
+    ++counters.calls[opcode];
+    if (size != 0) {
+        counters.bytes[opcode] += size;
+        ++counters.size_histogram[opcode][sizeBucket(size)];
+    }
+    if (isReadOperation(opcode)) {
+        counters.fd_bytes_read[summaryFd(values[0])] += size;
+    } else if (isWriteOperation(opcode)) {
+        counters.fd_bytes_written[summaryFd(values[0])] += size;
+        if (opcode == OP_SENDFILE) {
+            counters.fd_bytes_read[summaryFd(values[1])] += size;
+        }
+    } else if (opcode == OP_REALLOC && values[0] != 0) {
+        ++counters.realloc_growth[reallocGrowthBucket(values[2], values[1])];
+    }
+
+    if (!thread_summary.dirty) {
+        registerThread();
+        thread_summary.dirty = true;
+    }
+    uint64_t now = raw_clock_readers[channel]();
+    if (now - thread_summary.flushed_at >= header->clock_anchor.ticks_per_second / SUMMARY_FLUSH_DIVISOR) {
+        flushThreadSummary(channel);
+        thread_summary.flushed_at = now;
+    }
+}
+
+// Raw clock reading taken by a wrapper right before the libc call
+inline uint64_t startCall(Channel channel) {
+    return raw_clock_readers[channel]();
+}
+
+// Path an event refers to: that of a descriptor, looked up once the event is known to be logged,
+// or an id the wrapper looked up before a call that closes the descriptor
+struct EventPath {
+    int fd;
+    uint32_t file;
+
+    EventPath(int descriptor) : fd(descriptor), file(NO_PATH) {}
+
+    static EventPath resolved(uint32_t path) {
+        EventPath event_path(NO_DESCRIPTOR);
+        event_path.file = path;
+        return event_path;
+    }
+
+    uint32_t lookup() const {
+        return fd != NO_DESCRIPTOR ? descriptorPath(fd) : file;
+    }
+};
+
+// Log a call that started at start_timestamp; the call duration is measured up to now.
+// The payload goes to the string area of the record, the path goes with the event.
+template <typename... Arguments>
+void logEventPayload(Channel channel, EventOpcode opcode, uint64_t start_timestamp, int64_t result, EventPath path,
+                     const char* payload, uint32_t payload_length, Arguments... arguments) {
+    SharedMemoryHeader* header = shared_memory_headers[channel];
+    if (header == nullptr || in_interceptor || !isOperationEnabled(opcode)) {
+        return;
+    }
+    uint64_t duration = raw_clock_readers[channel]() - start_timestamp;
+    if (duration < min_latency_ticks[channel]) {
+        return;
+    }
+    // Nothing below allocates; the guard keeps libc internals that might from being logged recursively.
+    // The caller sees the errno of the libc call, not of the syscalls made while logging.
+    in_interceptor = true;
+    int saved_errno = errno;
+    if (filter_config.aggregate) {
+        const uint64_t values[] = {eventArgument(arguments)...};
+        aggregateEvent(channel, header, opcode, result, values);
+        errno = saved_errno;
+        in_interceptor = false;
+        return;
+    }
+    uint64_t timestamp = start_timestamp;
+    if (((filter_config.sampled_mask >> opcode) & 1u) == 0 || sampleEvent(channel, header, opcode, timestamp)) {
+        uint32_t file = path.lookup();
+        RingSlot* slot = acquireRing(channel, header);
+        if (slot != nullptr) {
+            if (file != NO_PATH) {
+                announcePath(channel, header, slot, file);
+            }
+            const uint64_t values[] = {eventArgument(arguments)...};
+            writeEvent(channel, header, slot, opcode, timestamp, duration, result, values, sizeof...(Arguments), payload,
+                       payload_length, file);
+            releaseRing(header, slot);
+        }
+    }
+    errno = saved_errno;
+    in_interceptor = false;
+}
+
+template <typename... Arguments>
+void logEvent(Channel channel, EventOpcode opcode, uint64_t start_timestamp, int64_t result, EventPath path,
+              const char* string, Arguments... arguments) {
+    uint32_t string_length = string != nullptr ? static_cast<uint32_t>(strnlen(string, MAX_EVENT_STRING_LENGTH)) : 0;
+    logEventPayload(channel, opcode, start_timestamp, result, path, string, string_length, arguments...);
+}
+
+// Stack of the calling thread, looked up before its first call stack is captured. pthread_getattr_np
+// reads /proc/self/maps for the main thread, so it runs with logging off; high stays 0 if it fails.
+void resolveStackBounds() {
+    stack_bounds.resolved = true;
+    in_interceptor = true;
+    pthread_attr_t attributes;
+    if (pthread_getattr_np(pthread_self(), &attributes) == 0) {
+        void* address = nullptr;
+        size_t size = 0;
+        if (pthread_attr_getstack(&attributes, &address, &size) == 0) {
+            stack_bounds.low = reinterpret_cast<uintptr_t>(address);
+            stack_bounds.high = stack_bounds.low + size;
+        }
+        pthread_attr_destroy(&attributes);
+    }
+    in_interceptor = false;
+}
+
+// Return addresses of the allocator's caller, read by walking the frame pointer chain from the wrapper.
+// Inlined into the wrapper, so frame 0 is always the call site; deeper frames need callers built with
+// frame pointers and the walk stops at the first frame that does not look like one or lies outside
+// the thread's stack, e.g. on a signal stack.
+__attribute__((always_inline)) inline uint32_t captureCallStack(uint64_t* frames, uint32_t max_depth) {
+    frames[0] = reinterpret_cast<uint64_t>(__builtin_return_address(0));
+    uint32_t depth = 1;
+    if (!stack_bounds.resolved) {
+        resolveStackBounds();
+    }
+    void** frame = static_cast<void**>(__builtin_frame_address(0));
+    while (depth < max_depth) {
+        void** next = static_cast<void**>(frame[0]);
+        uintptr_t address = reinterpret_cast<uintptr_t>(next);
+        if (next <= frame || address - reinterpret_cast<uintptr_t>(frame) > MAX_STACK_FRAME_SIZE ||
+            (address & (sizeof(void*) - 1)) != 0 || address < stack_bounds.low ||
+            address + 2 * sizeof(void*) > stack_bounds.high || next[1] == nullptr) {
+            break;
+        }
+        frame = next;
+        frames[depth++] = reinterpret_cast<uint64_t>(frame[1]);
+    }
+    return depth;
+}
+
+// Allocation events carry the call stack as their payload when stack= is set
+#define LOG_ALLOCATION(opcode, start, result, ...) \
+    do { \
+        uint64_t call_stack[MAX_CALL_STACK_DEPTH]; \
+        uint32_t call_stack_depth = filter_config.stack_depth != 0 && !in_interceptor && isOperationEnabled(opcode) \
+                                        ? captureCallStack(call_stack, filter_config.stack_depth) : 0; \
+        logEventPayload(CHANNEL_MEMMGMT, opcode, start, reinterpret_cast<int64_t>(result), NO_DESCRIPTOR, \
+                        reinterpret_cast<const char*>(call_stack), call_stack_depth * sizeof(uint64_t), __VA_ARGS__); \
+    } while (0)
+
+__attribute__((constructor))
+void initializeLibrary() {
+    ensureLibcResolved();
+    handleError(pthread_key_create(&thread_rings_key, releaseThreadRings) != 0, "Failed to create thread key");
+    pthread_atfork(nullptr, nullptr, resetThreadRingsInChild);
+    initializeRegistry(CHANNEL_FILEIO);
+    initializeRegistry(CHANNEL_MEMMGMT);
+    initializeFilters();
+    for (int channel = 0; channel < CHANNEL_COUNT; ++channel) {
+        min_latency_ticks[channel] = nanosecondsToRawClock(channel_registries[channel]->clock_anchor,
+                                                           filter_config.min_latency_us * 1000);
+    }
+    getCurrentProcessName();
+    registerChannels();
+}
+
+// Cleanup the library. Other threads may still be logging, so the channels stay mapped until the
+// process exits; closing the registry entries tells the daemon to drain them one last time.
+__attribute__((destructor))
+void finalizeLibrary() {
+    for (int channel = 0; channel < CHANNEL_COUNT; ++channel) {
+        // Counts of other threads still running are only merged up to their last flush
+        flushThreadSummary(static_cast<Channel>(channel));
+        closeChannel(static_cast<Channel>(channel));
+    }
+}
+
+// open and openat only read their mode argument when the flags create a file
+inline bool needsOpenMode(int flags) {
+    return (flags & O_CREAT) != 0 || (flags & O_TMPFILE) == O_TMPFILE;
+}
+
+// The path decision and the path are remembered per descriptor for the calls that follow
+template <typename... Arguments>
+void traceOpen(EventOpcode opcode, uint64_t start, int fd, const char* filename, Arguments... arguments) {
+    bool traced = matchesPathFilters(filename);
+    setFdTraced(fd, traced);
+    // Nothing is logged in aggregate mode, and nothing while the library itself opens files
+    if (fd >= 0) {
+        bool cached = traced && !filter_config.aggregate && !in_interceptor;
+        setDescriptorPath(fd, cached ? internPath(filename, static_cast<uint32_t>(strnlen(filename, MAX_EVENT_STRING_LENGTH)))
+                                     : NO_PATH);
+    }
+    if (traced) {
+        logEvent(CHANNEL_FILEIO, opcode, start, fd, fd, filename, arguments...);
+    }
+}
+
+#define READ_OPEN_MODE(flags, mode) \
+    mode_t mode = 0; \
+    if (needsOpenMode(flags)) { \
+        va_list args; \
+        va_start(args, flags); \
+        mode = va_arg(args, mode_t); \
+        va_end(args); \
+    }
+
+#define DEFINE_OPEN_WRAPPER(name) \
+    int name(const char* filename, int flags, ...) { \
+        ensureLibcResolved(); \
+        READ_OPEN_MODE(flags, mode) \
+        uint64_t start = isOperationEnabled(OP_OPEN) ? startCall(CHANNEL_FILEIO) : 0; \
+        int file_descriptor = libc_##name(filename, flags, mode); \
+        traceOpen(OP_OPEN, start, file_descriptor, filename, flags, mode); \
+        return file_descriptor; \
+    }
+
+#define DEFINE_OPENAT_WRAPPER(name) \
+    int name(int dirfd, const char* filename, int flags, ...) { \
+        ensureLibcResolved(); \
+        READ_OPEN_MODE(flags, mode) \
+        uint64_t start = isOperationEnabled(OP_OPENAT) ? startCall(CHANNEL_FILEIO) : 0; \
+        int file_descriptor = libc_##name(dirfd, filename, flags, mode); \
+        traceOpen(OP_OPENAT, start, file_descriptor, filename, dirfd, flags, mode); \
+        return file_descriptor; \
+    }
+
+#define DEFINE_FOPEN_WRAPPER(name) \
+    FILE* name(const char* filename, const char* mode) { \
+        ensureLibcResolved(); \
+        uint64_t start = isOperationEnabled(OP_FOPEN) ? startCall(CHANNEL_FILEIO) : 0; \
+        FILE* stream = libc_##name(filename, mode); \
+        traceOpen(OP_FOPEN, start, stream != nullptr ? fileno_unlocked(stream) : -1, filename); \
+        return stream; \
+    }
+
+// Uniform hot path of the table-generated wrappers: the clock is only read for enabled operations
+#define UNPACK_ARGUMENTS(...) __VA_ARGS__
+#define DEFINE_TRACED_WRAPPER(name, channel, opcode, type, parameters, arguments, condition, descriptor, logged_arguments) \
+    type name parameters { \
+        ensureLibcResolved(); \
+        bool enabled = isOperationEnabled(opcode); \
+        uint64_t start = enabled ? startCall(channel) : 0; \
+        type result = libc_##name arguments; \
+        if (enabled && (condition)) { \
+            logEvent(channel, opcode, start, static_cast<int64_t>(eventArgument(result)), descriptor, nullptr, \
+                     UNPACK_ARGUMENTS logged_arguments); \
+        } \
+        return result; \
+    }
+
+// Intercepted libc functions
+extern "C" {
+    DEFINE_OPEN_WRAPPER(open)
+    DEFINE_OPEN_WRAPPER(open64)
+    DEFINE_OPENAT_WRAPPER(openat)
+    DEFINE_OPENAT_WRAPPER(openat64)
+    DEFINE_FOPEN_WRAPPER(fopen)
+    DEFINE_FOPEN_WRAPPER(fopen64)
+    TRACED_FUNCTIONS(DEFINE_TRACED_WRAPPER)
+
+    int close(int fd) {
+        ensureLibcResolved();
+        bool traced = isFdTraced(fd);
+        bool enabled = traced && isOperationEnabled(OP_CLOSE);
+        // The descriptor and its path are gone once libc returns
+        uint32_t path = enabled ? descriptorPath(fd) : NO_PATH;
+        uint64_t start = enabled ? startCall(CHANNEL_FILEIO) : 0;
+        int return_code = libc_close(fd);
+        if (enabled) {
+            logEvent(CHANNEL_FILEIO, OP_CLOSE, start, return_code, EventPath::resolved(path), nullptr, fd);
+        }
+        if (traced) {
+            setFdTraced(fd, false);
+        }
+        setDescriptorPath(fd, NO_PATH);
+        return return_code;
+    }
+
+    int dup(int fd) {
+        ensureLibcResolved();
+        int new_fd = libc_dup(fd);
+        copyDescriptor(fd, new_fd);
+        return new_fd;
+    }
+
+    int dup2(int fd, int new_fd) {
+        ensureLibcResolved();
+        int result = libc_dup2(fd, new_fd);
+        copyDescriptor(fd, result);
+        return result;
+    }
+
+    int dup3(int fd, int new_fd, int flags) {
+        ensureLibcResolved();
+        int result = libc_dup3(fd, new_fd, flags);
+        copyDescriptor(fd, result);
+        return result;
+    }
+
+    int fclose(FILE* stream) {
+        ensureLibcResolved();
+        int fd = fileno_unlocked(stream);
+        bool traced = isFdTraced(fd);
+        bool enabled = traced && isOperationEnabled(OP_FCLOSE);
+        // The descriptor and its path are gone once libc returns
+        uint32_t path = enabled ? descriptorPath(fd) : NO_PATH;
+        uint64_t start = enabled ? startCall(CHANNEL_FILEIO) : 0;
+        int return_code = libc_fclose(stream);
+        if (enabled) {
+            logEvent(CHANNEL_FILEIO, OP_FCLOSE, start, return_code, EventPath::resolved(path), nullptr, fd);
+        }
+        if (traced) {
+            setFdTraced(fd, false);
+        }
+        setDescriptorPath(fd, NO_PATH);
+        return return_code;
+    }
+
+    void* malloc(size_t size) {
+        if (!ensureAllocatorResolved()) {
+            return bootstrap_arena.allocate(size);
+        }
+        bool enabled = isOperationEnabled(OP_MALLOC) && size >= filter_config.min_alloc_size;
+        uint64_t start = enabled ? startCall(CHANNEL_MEMMGMT) : 0;
+        void* pointer = libc_malloc(size);
+        if (enabled) {
+            LOG_ALLOCATION(OP_MALLOC, start, pointer, size);
+        }
+        return pointer;
+    }
+
+    void* calloc(size_t count, size_t size) {
+        if (!ensureAllocatorResolved()) {
+            // The arena is static storage, never handed out twice, so it is already zeroed
+            return count != 0 && size > SIZE_MAX / count ? nullptr : bootstrap_arena.allocate(count * size);
+        }
+        bool enabled = isOperationEnabled(OP_CALLOC) && count * size >= filter_config.min_alloc_size;
+        uint64_t start = enabled ? startCall(CHANNEL_MEMMGMT) : 0;
+        void* pointer = libc_calloc(count, size);
+        if (enabled) {
+            LOG_ALLOCATION(OP_CALLOC, start, pointer, count, size);
+        }
+        return pointer;
+    }
+
+    void* realloc(void* ptr, size_t size) {
+        bool resolved = ensureAllocatorResolved();
+        if (bootstrap_arena.contains(ptr) || (!resolved && ptr == nullptr)) {
+            void* new_ptr = resolved ? libc_malloc(size) : bootstrap_arena.allocate(size);
+            if (new_ptr != nullptr && ptr != nullptr) {
+                memcpy(new_ptr, ptr, std::min(bootstrap_arena.blockSize(ptr), size));
+            }
+            return new_ptr;
+        }
+        if (!resolved) {
+            // Allocated by libc before dlsym started, only the real realloc can resize it
+            if (libc_realloc == nullptr) {
+                errno = ENOMEM;
+                return nullptr;
+            }
+            return libc_realloc(ptr, size);
+        }
+        bool enabled = isOperationEnabled(OP_REALLOC);
+        size_t old_size = enabled && ptr != nullptr ? malloc_usable_size(ptr) : 0;
+        // Shrinking a logged block below min_alloc still frees it, growing past it allocates one
+        enabled = enabled && (size >= filter_config.min_alloc_size || old_size >= filter_config.min_alloc_size);
+        uint64_t start = enabled ? startCall(CHANNEL_MEMMGMT) : 0;
+        auto new_ptr = libc_realloc(ptr, size);
+        if (enabled) {
+            LOG_ALLOCATION(OP_REALLOC, start, new_ptr, ptr, size, old_size);
+        }
+        return new_ptr;
+    }
+
+    void free(void* ptr) {
+        if (bootstrap_arena.contains(ptr) || !ensureAllocatorResolved()) {
+            return;
+        }
+        bool enabled = isOperationEnabled(OP_FREE);
+        uint64_t start = enabled ? startCall(CHANNEL_MEMMGMT) : 0;
+        libc_free(ptr);
+        if (enabled) {
+            logEvent(CHANNEL_MEMMGMT, OP_FREE, start, 0, NO_DESCRIPTOR, nullptr, ptr);
+        }
+    }
+
+    int posix_memalign(void** memptr, size_t alignment, size_t size) {
+        if (!ensureAllocatorResolved()) {
+            if (!isPowerOfTwo(alignment) || alignment % sizeof(void*) != 0) {
+                return EINVAL;
+            }
+            void* pointer = bootstrap_arena.allocate(size, alignment);
+            if (pointer == nullptr) {
+                return ENOMEM;
+            }
+            *memptr = pointer;
+            return 0;
+        }
+        bool enabled = isOperationEnabled(OP_POSIX_MEMALIGN) && size >= filter_config.min_alloc_size;
+        uint64_t start = enabled ? startCall(CHANNEL_MEMMGMT) : 0;
+        int return_code = libc_posix_memalign(memptr, alignment, size);
+        if (enabled) {
+            void* pointer = return_code == 0 ? *memptr : nullptr;
+            LOG_ALLOCATION(OP_POSIX_MEMALIGN, start, pointer, alignment, size, return_code);
+        }
+        return return_code;
+    }
+
+    void* aligned_alloc(size_t alignment, size_t size) {
+        if (!ensureAllocatorResolved()) {
+            return bootstrap_arena.allocate(size, alignment);
+        }
+        bool enabled = isOperationEnabled(OP_ALIGNED_ALLOC) && size >= filter_config.min_alloc_size;
+        uint64_t start = enabled ? startCall(CHANNEL_MEMMGMT) : 0;
+        void* pointer = libc_aligned_alloc(alignment, size);
+        if (enabled) {
+            LOG_ALLOCATION(OP_ALIGNED_ALLOC, start, pointer, alignment, size);
+        }
+        return pointer;
+    }
+
+    void* memalign(size_t alignment, size_t size) {
+        if (!ensureAllocatorResolved()) {
+            return bootstrap_arena.allocate(size, alignment);
+        }
+        bool enabled = isOperationEnabled(OP_MEMALIGN) && size >= filter_config.min_alloc_size;
+        uint64_t start = enabled ? startCall(CHANNEL_MEMMGMT) : 0;
+        void* pointer = libc_memalign(alignment, size);
+        if (enabled) {
+            LOG_ALLOCATION(OP_MEMALIGN, start, pointer, alignment, size);
+        }
+        return pointer;
+    }
+
+    void* valloc(size_t size) {
+        if (!ensureAllocatorResolved()) {
+            return bootstrap_arena.allocate(size, static_cast<size_t>(getpagesize()));
+        }
+        bool enabled = isOperationEnabled(OP_VALLOC) && size >= filter_config.min_alloc_size;
+        uint64_t start = enabled ? startCall(CHANNEL_MEMMGMT) : 0;
+        void* pointer = libc_valloc(size);
+        if (enabled) {
+            LOG_ALLOCATION(OP_VALLOC, start, pointer, size);
+        }
+        return pointer;
+    }
 }
\ No newline at end of file
@@ -0,0 +1,335 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <getopt.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "columnar_log.h"
+#include "event_format.h"
+
+// Query tool for the columnar logs the daemon writes with -C. The files are mapped, blocks whose
+// index shows no matching time, PID or operation are skipped without touching their columns, and
+// the remaining blocks are decoded by a pool of threads. Matching events are printed in file order
+// in the daemon's text log format.
+//
+//   libclog-query [-p pids] [-o operations] [-f file_descriptors] [-s start] [-e end] [-j threads] <file.clog>...
+
+// Blocks decoded per round; output of a round is printed before the next one starts
+const size_t BLOCKS_PER_THREAD = 4;
+
+struct QueryOptions {
+    std::vector<uint32_t> pids;
+    uint64_t opcode_mask;
+    std::vector<int64_t> file_descriptors;
+    uint64_t start_ns;
+    uint64_t end_ns;
+    uint32_t thread_count;
+};
+
+struct MappedFile {
+    const uint8_t* data;
+    size_t size;
+};
+
+struct BlockTask {
+    ColumnBlockHeader header;
+    const uint8_t* columns;
+    std::string output;
+};
+
+QueryOptions query_options;
+
+// Per opcode, the argument positions and whether the result hold a file descriptor
+uint32_t descriptor_arguments[OP_COUNT];
+bool descriptor_results[OP_COUNT];
+
+void handleError(bool condition, const char* error_message) {
+    if (condition) {
+        perror(error_message);
+        exit(EXIT_FAILURE);
+    }
+}
+
+bool isDescriptorName(const char* name, size_t length) {
+    static const char* const names[] = {"file_descriptor", "fd", "out_fd", "in_fd"};
+    for (const char* descriptor : names) {
+        if (strlen(descriptor) == length && strncmp(descriptor, name, length) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void findDescriptorFields() {
+    for (uint32_t opcode = 0; opcode < OP_COUNT; ++opcode) {
+        const char* entry = EVENT_ARGUMENT_FORMATS[opcode];
+        for (uint32_t index = 0; *entry != '\0'; ++index) {
+            const char* colon = strchr(entry, ':');
+            if (colon != nullptr && isDescriptorName(entry, static_cast<size_t>(colon - entry))) {
+                descriptor_arguments[opcode] |= 1u << index;
+            }
+            const char* comma = strchr(entry, ',');
+            entry = comma != nullptr ? comma + 1 : entry + strlen(entry);
+        }
+        const char* result = EVENT_RESULT_FORMATS[opcode];
+        const char* colon = strchr(result, ':');
+        descriptor_results[opcode] = colon != nullptr && isDescriptorName(result, static_cast<size_t>(colon - result));
+    }
+}
+
+bool isMatchingDescriptor(int64_t fd) {
+    const std::vector<int64_t>& descriptors = query_options.file_descriptors;
+    return std::find(descriptors.begin(), descriptors.end(), fd) != descriptors.end();
+}
+
+bool isMatchingEvent(const EventRecord* event, uint32_t pid) {
+    if (event->opcode >= OP_COUNT || (query_options.opcode_mask & (1ull << event->opcode)) == 0) {
+        return false;
+    }
+    if (!query_options.pids.empty() &&
+        std::find(query_options.pids.begin(), query_options.pids.end(), pid) == query_options.pids.end()) {
+        return false;
+    }
+    if (query_options.file_descriptors.empty()) {
+        return true;
+    }
+    for (uint32_t index = 0; index < event->argument_count; ++index) {
+        if ((descriptor_arguments[event->opcode] >> index & 1u) != 0 &&
+            isMatchingDescriptor(static_cast<int32_t>(eventArguments(event)[index]))) {
+            return true;
+        }
+    }
+    return descriptor_results[event->opcode] && isMatchingDescriptor(event->result);
+}
+
+// Decide from the block index alone whether any row can match
+bool isBlockSelected(const ColumnBlockHeader& header) {
+    if ((header.opcode_mask & query_options.opcode_mask) == 0) {
+        return false;
+    }
+    if (rawClockToRealtime(header.clock_anchor, header.max_timestamp) < query_options.start_ns ||
+        rawClockToRealtime(header.clock_anchor, header.min_timestamp) > query_options.end_ns) {
+        return false;
+    }
+    if (query_options.pids.empty()) {
+        return true;
+    }
+    for (uint32_t pid : query_options.pids) {
+        if (pid >= header.min_pid && pid <= header.max_pid && isPidInBitmap(header.pid_bitmap, pid)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void decodeBlock(BlockTask& task) {
+    ColumnBlockDecoder decoder;
+    if (!decoder.open(&task.header, task.columns)) {
+        return;
+    }
+    TimestampCache cache = {-1, "", ""};
+    std::string process_name;
+    char line[MAX_LINE_LENGTH];
+    uint32_t pid;
+    const char* name;
+    uint32_t name_length;
+    const char* path;
+    uint32_t path_length;
+    while (const EventRecord* event = decoder.next(pid, name, name_length, path, path_length)) {
+        uint64_t timestamp = rawClockToRealtime(task.header.clock_anchor, event->timestamp);
+        if (timestamp < query_options.start_ns || timestamp > query_options.end_ns || !isMatchingEvent(event, pid)) {
+            continue;
+        }
+        process_name.assign(name, name_length);
+        int length = formatEvent(event, pid, process_name.c_str(), path, path_length, task.header.clock_anchor, cache,
+                                 line, sizeof(line));
+        task.output.append(line, std::min(static_cast<size_t>(length), sizeof(line) - 1));
+    }
+}
+
+MappedFile mapFile(const char* file_name) {
+    int fd = open(file_name, O_RDONLY | O_CLOEXEC);
+    handleError(fd == -1, "Failed to open log file");
+    struct stat file_stat;
+    handleError(fstat(fd, &file_stat) == -1, "Failed to stat log file");
+    MappedFile file = {nullptr, static_cast<size_t>(file_stat.st_size)};
+    if (file.size != 0) {
+        void* data = mmap(nullptr, file.size, PROT_READ, MAP_PRIVATE, fd, 0);
+        handleError(data == MAP_FAILED, "Failed to map log file");
+        madvise(data, file.size, MADV_SEQUENTIAL);
+        file.data = static_cast<const uint8_t*>(data);
+    }
+    close(fd);
+    return file;
+}
+
+// Walk the block headers of a file and queue the blocks the index selects
+void collectBlocks(const char* file_name, const MappedFile& file, std::vector<BlockTask>& tasks) {
+    size_t offset = 0;
+    while (offset < file.size) {
+        BlockTask task;
+        if (!readColumnBlockHeader(file.data, file.size, offset, task.header)) {
+            std::cerr << file_name << ": truncated or invalid block at offset " << offset << std::endl;
+            return;
+        }
+        task.columns = file.data + offset + sizeof(task.header);
+        offset += sizeof(task.header) + task.header.block_size;
+        if (isBlockSelected(task.header)) {
+            tasks.push_back(std::move(task));
+        }
+    }
+}
+
+void decodeBlocks(std::vector<BlockTask>& tasks) {
+    size_t round_size = query_options.thread_count * BLOCKS_PER_THREAD;
+    for (size_t first = 0; first < tasks.size(); first += round_size) {
+        size_t last = std::min(first + round_size, tasks.size());
+        std::atomic<size_t> next(first);
+        auto worker = [&tasks, &next, last] {
+            for (size_t index = next++; index < last; index = next++) {
+                decodeBlock(tasks[index]);
+            }
+        };
+        std::vector<std::thread> threads;
+        for (uint32_t count = 1; count < std::min<size_t>(query_options.thread_count, last - first); ++count) {
+            threads.emplace_back(worker);
+        }
+        worker();
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+        for (size_t index = first; index < last; ++index) {
+            fwrite(tasks[index].output.data(), 1, tasks[index].output.size(), stdout);
+            std::string().swap(tasks[index].output);
+        }
+    }
+}
+
+bool parseOperations(const char* value, uint64_t& opcode_mask) {
+    opcode_mask = 0;
+    std::string list(value);
+    size_t position = 0;
+    while (position <= list.size()) {
+        size_t comma = list.find(',', position);
+        std::string name = list.substr(position, comma == std::string::npos ? std::string::npos : comma - position);
+        uint32_t opcode = 0;
+        while (opcode < OP_COUNT && name != EVENT_OPCODE_NAMES[opcode]) {
+            ++opcode;
+        }
+        if (opcode == OP_COUNT) {
+            return false;
+        }
+        opcode_mask |= 1ull << opcode;
+        if (comma == std::string::npos) {
+            break;
+        }
+        position = comma + 1;
+    }
+    return true;
+}
+
+template <typename T>
+bool parseNumberList(const char* value, std::vector<T>& numbers) {
+    while (*value != '\0') {
+        char* end = nullptr;
+        numbers.push_back(static_cast<T>(std::strtoll(value, &end, 10)));
+        if (end == value || (*end != ',' && *end != '\0')) {
+            return false;
+        }
+        value = *end == ',' ? end + 1 : end;
+    }
+    return !numbers.empty();
+}
+
+// Local time as "YYYY-MM-DD hh:mm:ss", or seconds since the epoch
+bool parseTime(const char* value, uint64_t& nanoseconds) {
+    struct tm time_info;
+    memset(&time_info, 0, sizeof(time_info));
+    const char* end = strptime(value, "%Y-%m-%d %H:%M:%S", &time_info);
+    if (end != nullptr && *end == '\0') {
+        time_info.tm_isdst = -1;
+        nanoseconds = static_cast<uint64_t>(mktime(&time_info)) * 1000000000ull;
+        return true;
+    }
+    char* number_end = nullptr;
+    double seconds = std::strtod(value, &number_end);
+    if (number_end == value || *number_end != '\0' || seconds < 0) {
+        return false;
+    }
+    nanoseconds = static_cast<uint64_t>(seconds * 1e9);
+    return true;
+}
+
+void printUsage(const char* program_name) {
+    std::cerr << "Usage: " << program_name << " [-p pids] [-o operations] [-f file_descriptors]"
+              << " [-s start (YYYY-MM-DD hh:mm:ss / epoch seconds)] [-e end] [-j threads] <file.clog>..." << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    query_options.opcode_mask = (1ull << OP_COUNT) - 1;
+    query_options.start_ns = 0;
+    query_options.end_ns = UINT64_MAX;
+    query_options.thread_count = std::max(1u, std::thread::hardware_concurrency());
+    int option;
+    while ((option = getopt(argc, argv, "p:o:f:s:e:j:")) != -1) {
+        bool valid = true;
+        switch (option) {
+            case 'p':
+                valid = parseNumberList(optarg, query_options.pids);
+                break;
+            case 'o':
+                valid = parseOperations(optarg, query_options.opcode_mask);
+                break;
+            case 'f':
+                valid = parseNumberList(optarg, query_options.file_descriptors);
+                break;
+            case 's':
+                valid = parseTime(optarg, query_options.start_ns);
+                break;
+            case 'e':
+                valid = parseTime(optarg, query_options.end_ns);
+                break;
+            case 'j':
+                query_options.thread_count = static_cast<uint32_t>(std::strtoul(optarg, nullptr, 10));
+                valid = query_options.thread_count != 0;
+                break;
+            default:
+                valid = false;
+                break;
+        }
+        if (!valid) {
+            printUsage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (optind == argc) {
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    findDescriptorFields();
+    std::vector<MappedFile> files;
+    std::vector<BlockTask> tasks;
+    for (int index = optind; index < argc; ++index) {
+        files.push_back(mapFile(argv[index]));
+        collectBlocks(argv[index], files.back(), tasks);
+    }
+    decodeBlocks(tasks);
+    for (const MappedFile& file : files) {
+        if (file.data != nullptr) {
+            munmap(const_cast<uint8_t*>(file.data), file.size);
+        }
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,211 @@
+#ifndef LIBCLOG_SHARED_MEMORY_H
+#define LIBCLOG_SHARED_MEMORY_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "clock_source.h"
+#include "event_record.h"
+
+// Shared memory used by the interceptor (producers) and the daemon (consumer).
+//
+// The daemon creates one registry per channel (/shm_fileio, /shm_memmgmt) holding the ring
+// geometry, the clock and the doorbell:
+//
+//   [ChannelRegistry][ChannelEntry x channel_count]
+//
+// Every preloaded process, and every child after fork, creates its own channel segment
+// <registry name>.<pid>.<entry>, registers it in a registry entry and rings the doorbell:
+//
+//   [SharedMemoryHeader][RingSlot x ring_count][ring buffer x ring_count][ProcessSummary]
+//
+// Every producer thread claims its own ring slot, so each ring has exactly one
+// producer and one consumer. Slot 0 is the overflow ring, shared under a lock by
+// threads that found no free slot. In aggregation mode the threads merge their
+// counters into the process summary instead.
+
+const char* const SHARED_MEMORY_FILEIO_NAME = "/shm_fileio";
+const char* const SHARED_MEMORY_MEMMGMT_NAME = "/shm_memmgmt";
+
+const uint32_t SHARED_MEMORY_MAGIC = 0x474f4c43; // "CLOG"
+const uint32_t SHARED_MEMORY_VERSION = 12;
+const size_t CACHE_LINE_SIZE = 64;
+
+const uint32_t DEFAULT_CHANNEL_COUNT = 1024;
+const uint32_t MAX_CHANNEL_COUNT = 65536;
+const uint32_t DEFAULT_RING_COUNT = 16;
+const uint32_t DEFAULT_RING_SIZE = 64 * 1024;
+const uint32_t MIN_RING_SIZE = 16 * 1024;
+const uint32_t MAX_RING_SIZE = 64 * 1024 * 1024;
+const uint32_t MAX_RING_COUNT = 4096;
+const size_t CHANNEL_NAME_SIZE = 64;
+const size_t PROCESS_NAME_SIZE = 4096;
+const uint32_t OVERFLOW_RING_INDEX = 0;
+const uint32_t DEFAULT_HIGH_WATER_PERCENT = 25;
+
+// Aggregation summaries: sizes are bucketed by their highest set bit, realloc growth by
+// log2(new size / old size) clamped to [-8, 8]
+const uint32_t SUMMARY_FD_COUNT = 256;
+const uint32_t SIZE_HISTOGRAM_BUCKETS = 65;
+const int REALLOC_GROWTH_LIMIT = 8;
+const uint32_t REALLOC_GROWTH_BUCKETS = 2 * REALLOC_GROWTH_LIMIT + 1;
+
+// Records are 8-byte aligned; a padding record fills the gap at the end of the ring
+const uint32_t RECORD_ALIGNMENT = 8;
+const uint32_t RECORD_PADDING_FLAG = 0x80000000u;
+
+struct RecordHeader {
+    uint32_t length;    // Total record length including this header, multiple of RECORD_ALIGNMENT
+    uint32_t sequence;  // Per-ring sequence number, gaps mean dropped records
+};
+
+struct RingSlot {
+    // Ownership, written when a thread claims or releases the slot
+    alignas(CACHE_LINE_SIZE) std::atomic<uint32_t> owner_tid;
+    std::atomic<uint32_t> overflow_lock;
+
+    // Producer side
+    alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> head;
+    std::atomic<uint32_t> next_sequence;
+    std::atomic<uint64_t> dropped;
+
+    // Consumer side
+    alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> tail;
+};
+
+// Counters kept per thread (plain integers) and per process in shared memory (atomics)
+template <typename Counter>
+struct SummaryCounters {
+    Counter calls[OP_COUNT];
+    Counter bytes[OP_COUNT];
+    Counter size_histogram[OP_COUNT][SIZE_HISTOGRAM_BUCKETS];
+    Counter fd_bytes_read[SUMMARY_FD_COUNT];
+    Counter fd_bytes_written[SUMMARY_FD_COUNT];
+    Counter realloc_growth[REALLOC_GROWTH_BUCKETS];
+};
+
+// Summary of the channel's process, snapshotted by the daemon once published is set.
+// Trace mode never touches it, so its pages are not allocated.
+struct ProcessSummary {
+    alignas(CACHE_LINE_SIZE) std::atomic<uint32_t> published;
+    alignas(CACHE_LINE_SIZE) SummaryCounters<std::atomic<uint64_t>> counters;
+};
+
+inline uint32_t sizeBucket(uint64_t size) {
+    return size == 0 ? 0 : 64 - __builtin_clzll(size);
+}
+
+// Smallest size falling into a bucket
+inline uint64_t sizeBucketLowerBound(uint32_t bucket) {
+    return bucket == 0 ? 0 : 1ull << (bucket - 1);
+}
+
+inline uint32_t reallocGrowthBucket(uint64_t old_size, uint64_t new_size) {
+    int growth = static_cast<int>(sizeBucket(new_size)) - static_cast<int>(sizeBucket(old_size));
+    growth = growth < -REALLOC_GROWTH_LIMIT ? -REALLOC_GROWTH_LIMIT : growth > REALLOC_GROWTH_LIMIT ? REALLOC_GROWTH_LIMIT : growth;
+    return static_cast<uint32_t>(growth + REALLOC_GROWTH_LIMIT);
+}
+
+// Lifecycle of a registry entry. A process claims a free entry, creates its channel and
+// activates it; it closes the entry at exit or when it registers again after an exec.
+// The daemon drains closed channels and channels of dead processes, then frees the entry.
+enum ChannelState : uint32_t {
+    CHANNEL_FREE,
+    CHANNEL_CLAIMED,
+    CHANNEL_ACTIVE,
+    CHANNEL_CLOSED
+};
+
+struct ChannelEntry {
+    std::atomic<uint32_t> state;
+    std::atomic<uint32_t> pid;
+};
+
+struct ChannelRegistry {
+    alignas(CACHE_LINE_SIZE) std::atomic<uint32_t> magic;  // Published last by the daemon
+    uint32_t version;
+    uint32_t channel_count;
+    uint32_t ring_count;     // Rings in each process channel
+    uint32_t ring_size;
+    uint32_t clock_source;   // ClockSource used for event timestamps
+    uint32_t high_water_mark;  // Ring fill level in bytes that wakes the daemon
+    ClockAnchor clock_anchor;
+
+    // Doorbell futex, rung by producers whose ring crosses the high-water mark while the daemon
+    // waits, and by processes that register or close a channel
+    alignas(CACHE_LINE_SIZE) std::atomic<uint32_t> doorbell;
+    std::atomic<uint32_t> consumer_waiting;
+
+    // Bumped on every registration and close, the daemon rescans the entries when it moves
+    alignas(CACHE_LINE_SIZE) std::atomic<uint32_t> generation;
+    std::atomic<uint64_t> rejected;  // Processes that found no free entry and log nothing
+};
+
+// Header of a process channel, written by the process before it activates its registry entry
+struct SharedMemoryHeader {
+    alignas(CACHE_LINE_SIZE) std::atomic<uint32_t> magic;
+    uint32_t version;
+    uint32_t pid;
+    uint32_t ring_count;
+    uint32_t ring_size;
+    uint32_t clock_source;
+    uint32_t high_water_mark;
+    uint32_t frees_complete;  // No filter skips a free or realloc, each one that succeeded is logged
+    ClockAnchor clock_anchor;
+    char process_name[PROCESS_NAME_SIZE];
+    std::atomic<uint64_t> uninterned_paths;  // Lookups that found the path table full, fileio only
+};
+
+inline uint32_t alignRecordLength(uint32_t length) {
+    return (length + RECORD_ALIGNMENT - 1) & ~(RECORD_ALIGNMENT - 1);
+}
+
+inline size_t registrySize(uint32_t channel_count) {
+    return sizeof(ChannelRegistry) + channel_count * sizeof(ChannelEntry);
+}
+
+inline ChannelEntry* channelEntry(ChannelRegistry* registry, uint32_t index) {
+    return reinterpret_cast<ChannelEntry*>(registry + 1) + index;
+}
+
+// Name of the channel segment a process registered in an entry
+inline void channelSegmentName(char* name, size_t size, const char* registry_name, uint32_t pid, uint32_t index) {
+    snprintf(name, size, "%s.%u.%u", registry_name, pid, index);
+}
+
+inline size_t sharedMemorySize(uint32_t ring_count, uint32_t ring_size) {
+    return sizeof(SharedMemoryHeader) + ring_count * sizeof(RingSlot) + static_cast<size_t>(ring_count) * ring_size +
+           sizeof(ProcessSummary);
+}
+
+inline RingSlot* ringSlot(SharedMemoryHeader* header, uint32_t index) {
+    return reinterpret_cast<RingSlot*>(reinterpret_cast<char*>(header) + sizeof(SharedMemoryHeader)) + index;
+}
+
+inline char* ringBuffer(SharedMemoryHeader* header, uint32_t index) {
+    return reinterpret_cast<char*>(header) + sizeof(SharedMemoryHeader) +
+           header->ring_count * sizeof(RingSlot) + static_cast<size_t>(index) * header->ring_size;
+}
+
+inline ProcessSummary* processSummary(SharedMemoryHeader* header) {
+    return reinterpret_cast<ProcessSummary*>(ringBuffer(header, header->ring_count));
+}
+
+// The segment is shared between processes, so the futex must not be FUTEX_PRIVATE
+inline void ringDoorbell(ChannelRegistry* registry) {
+    registry->doorbell.fetch_add(1, std::memory_order_release);
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&registry->doorbell), FUTEX_WAKE, 1, nullptr, nullptr, 0);
+}
+
+// Block until the doorbell moves past observed_value, the timeout expires or a signal arrives
+inline void waitDoorbell(ChannelRegistry* registry, uint32_t observed_value, const struct timespec& timeout) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&registry->doorbell), FUTEX_WAIT, observed_value, &timeout, nullptr, 0);
+}
+
+#endif // LIBCLOG_SHARED_MEMORY_H
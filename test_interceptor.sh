@@ -1,18 +1,56 @@
-#!/bin/bash  
+#!/bin/bash
 
-# Set LD_PRELOAD to load the interceptor library 
-./daemon fileio fileio.txt 1 & 
-PID1=$!  
+rm -f fileio.txt filememmgmt.txt
 
-./daemon memmgmt filememmgmt.txt 1 &
-PID2=$!  
+# Set LD_PRELOAD to load the interceptor library
+./daemon fileio fileio.txt 1 &
+PID1=$!
 
-sleep 2  
+# Rings large enough that the concurrent allocation test never drops a record
+./daemon memmgmt filememmgmt.txt 1 -M 1 -r 8 -s 8388608 &
+PID2=$!
 
-LD_PRELOAD=./libc_interceptor.so ./unit_test 
-TEST_RESULT=$?  
+sleep 2
 
-kill $PID1 || echo "Failed to kill process with PID $PID1"
-kill $PID2 || echo "Failed to kill process with PID $PID2"
+LD_PRELOAD=./liblibc_interceptor.so ./unit_test
+TEST_RESULT=$?
 
-exit $TEST_RESULT
\ No newline at end of file
+# Many short-lived processes; most exit before a scan of the daemon sees their channels active
+SHORT_LIVED_PIDS=()
+for run in $(seq 1 100); do
+    LD_PRELOAD=./liblibc_interceptor.so ./unit_test > /dev/null &
+    SHORT_LIVED_PIDS+=($!)
+done
+for pid in "${SHORT_LIVED_PIDS[@]}"; do
+    wait $pid || TEST_RESULT=1
+done
+
+# Threads freeing each other's blocks while allocating; with one malloc arena freed addresses are
+# handed out again right away, and nothing may be left live once the process exits
+MALLOC_ARENA_MAX=1 LIBCLOG_FILTER="ops=malloc,free,realloc;min_alloc=8192" LD_PRELOAD=./liblibc_interceptor.so ./unit_test concurrent &
+CONCURRENT_PID=$!
+wait $CONCURRENT_PID || TEST_RESULT=1
+
+kill -INT $PID1 || echo "Failed to kill process with PID $PID1"
+kill -INT $PID2 || echo "Failed to kill process with PID $PID2"
+wait $PID1 $PID2
+
+# Every process must have its events drained, however briefly its channels lived
+MISSING=0
+for pid in "${SHORT_LIVED_PIDS[@]}"; do
+    if ! grep -q "PID=$pid, .* close: " fileio.txt || ! grep -q "PID=$pid, .* malloc: " filememmgmt.txt; then
+        MISSING=$((MISSING + 1))
+    fi
+done
+if [ $MISSING -ne 0 ]; then
+    echo "Events of $MISSING short-lived processes were not logged"
+    TEST_RESULT=1
+fi
+
+if ! grep -q "PID=$CONCURRENT_PID, .* leaks: live_bytes=0, live_blocks=0," filememmgmt.txt; then
+    echo "Allocations of the concurrent allocation test were left live:"
+    grep "PID=$CONCURRENT_PID, .* leaks: " filememmgmt.txt
+    TEST_RESULT=1
+fi
+
+exit $TEST_RESULT
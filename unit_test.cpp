@@ -1,71 +1,374 @@
-#include <iostream>
-#include <unistd.h>
-#include <fcntl.h>
-#include <cstring>
-#include <chrono>
-
-// Function to check for errors and handle them appropriately
-void handleError(bool condition, const char* error_message) {
-    if (condition) {
-        perror(error_message);
-        exit(EXIT_FAILURE);
-    }
-}
-
-// Function to demonstrate file I/O operations
-void testFileIO() {
-    int file_descriptor = open("test_file.txt", O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
-    handleError(file_descriptor == -1, "Failed to open file");
-
-    const char* write_buffer = "sabd";
-    ssize_t bytes_written = write(file_descriptor, write_buffer, strlen(write_buffer));
-    handleError(bytes_written == -1, "Failed to write to file");
-
-    char read_buffer[10];
-    ssize_t bytes_read = read(file_descriptor, read_buffer, sizeof(read_buffer) - 1);
-    handleError(bytes_read == -1, "Failed to read from file");
-    read_buffer[bytes_read] = '\0';
-
-    off_t seek_result = lseek(file_descriptor, 0, SEEK_CUR);
-    handleError(seek_result == -1, "Failed to seek in file");
-
-    int close_result = close(file_descriptor);
-    handleError(close_result == -1, "Failed to close file");
-}
-
-// Function to test dynamic memory allocation
-void testMemoryAllocation() {
-    void* memory_ptr = malloc(10);
-    handleError(memory_ptr == NULL, "Failed to allocate memory");
-
-    free(memory_ptr);
-}
-
-// Function to test memory reallocation
-void testMemoryReallocation() {
-    void* memory_ptr = malloc(100);
-    handleError(memory_ptr == NULL, "Failed to allocate memory");
-
-    memory_ptr = realloc(memory_ptr, 200);
-    handleError(memory_ptr == NULL, "Failed to reallocate memory");
-
-    free(memory_ptr);
-}
-
-int main() {
-    auto start = std::chrono::high_resolution_clock::now();
-    // Test file I/O
-    testFileIO();
-
-    // Test dynamic memory allocation
-    testMemoryAllocation();
-
-    // Test memory reallocation
-    testMemoryReallocation();
-
-    auto end = std::chrono::high_resolution_clock::now();
-
-    std::chrono::duration<double> duration = end - start;
-    std::cout << "Exec time: " << duration.count() << " sec" << std::endl;
-    return 0;
+#include <iostream>
+#include <unistd.h>
+#include <fcntl.h>
+#include <cstring>
+#include <cstdlib>
+#include <chrono>
+#include <cstdint>
+#include <atomic>
+#include <thread>
+#include <string>
+#include <vector>
+
+#include "bootstrap_arena.h"
+#include "columnar_log.h"
+#include "latency_histogram.h"
+
+// Function to check for errors and handle them appropriately
+void handleError(bool condition, const char* error_message) {
+    if (condition) {
+        perror(error_message);
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Function to demonstrate file I/O operations
+void testFileIO() {
+    int file_descriptor = open("test_file.txt", O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+    handleError(file_descriptor == -1, "Failed to open file");
+
+    const char* write_buffer = "sabd";
+    ssize_t bytes_written = write(file_descriptor, write_buffer, strlen(write_buffer));
+    handleError(bytes_written == -1, "Failed to write to file");
+
+    char read_buffer[10];
+    ssize_t bytes_read = read(file_descriptor, read_buffer, sizeof(read_buffer) - 1);
+    handleError(bytes_read == -1, "Failed to read from file");
+    read_buffer[bytes_read] = '\0';
+
+    off_t seek_result = lseek(file_descriptor, 0, SEEK_CUR);
+    handleError(seek_result == -1, "Failed to seek in file");
+
+    int close_result = close(file_descriptor);
+    handleError(close_result == -1, "Failed to close file");
+}
+
+// Function to test dynamic memory allocation
+void testMemoryAllocation() {
+    void* memory_ptr = malloc(10);
+    handleError(memory_ptr == NULL, "Failed to allocate memory");
+
+    free(memory_ptr);
+}
+
+// Function to test memory reallocation
+void testMemoryReallocation() {
+    void* memory_ptr = malloc(100);
+    handleError(memory_ptr == NULL, "Failed to allocate memory");
+
+    memory_ptr = realloc(memory_ptr, 200);
+    handleError(memory_ptr == NULL, "Failed to reallocate memory");
+
+    free(memory_ptr);
+}
+
+// Function to test zeroed and aligned allocation
+void testAlignedAllocation() {
+    void* zeroed_ptr = calloc(4, 16);
+    handleError(zeroed_ptr == NULL, "Failed to allocate zeroed memory");
+    free(zeroed_ptr);
+
+    void* aligned_ptr = NULL;
+    handleError(posix_memalign(&aligned_ptr, 64, 128) != 0, "Failed to allocate aligned memory");
+    free(aligned_ptr);
+
+    aligned_ptr = aligned_alloc(64, 128);
+    handleError(aligned_ptr == NULL, "Failed to allocate aligned memory");
+    free(aligned_ptr);
+}
+
+// Function to test that consecutive bootstrap arena blocks keep their alignment and sizes
+void testBootstrapArena() {
+    static BootstrapArena<4096> arena;
+    const size_t sizes[] = {1, 24, 7, 100, 0, 33, 16};
+    char* previous_end = arena.memory;
+    for (size_t size : sizes) {
+        char* block = static_cast<char*>(arena.allocate(size));
+        handleError(block == NULL, "Failed to allocate from the bootstrap arena");
+        handleError(reinterpret_cast<uintptr_t>(block) % BOOTSTRAP_ALIGNMENT != 0, "Misaligned bootstrap arena block");
+        handleError(block < previous_end + BOOTSTRAP_ALIGNMENT, "Overlapping bootstrap arena blocks");
+        handleError(!arena.contains(block) || arena.blockSize(block) != size, "Wrong bootstrap arena block size");
+        previous_end = block + size;
+    }
+
+    const size_t alignments[] = {64, 32, 256, 16, 1024};
+    for (size_t alignment : alignments) {
+        char* block = static_cast<char*>(arena.allocate(40, alignment));
+        handleError(block == NULL, "Failed to allocate from the bootstrap arena");
+        handleError(reinterpret_cast<uintptr_t>(block) % alignment != 0, "Misaligned bootstrap arena block");
+        handleError(block < previous_end + BOOTSTRAP_ALIGNMENT, "Overlapping bootstrap arena blocks");
+        handleError(arena.blockSize(block) != 40, "Wrong bootstrap arena block size");
+        previous_end = block + 40;
+    }
+
+    handleError(arena.allocate(8, 48) != NULL, "Accepted a non power of two alignment");
+    handleError(arena.allocate(4096) != NULL, "Allocated past the end of the bootstrap arena");
+}
+
+// An event of a columnar block, as the daemon passes it to the encoder
+struct ColumnTestEvent {
+    std::vector<uint64_t> record;  // EventRecord, arguments and string
+    uint32_t pid;
+    std::string process_name;
+    std::string path;
+};
+
+// Append the events to a block and write it out the way the daemon flushes it
+void encodeColumnBlock(const std::vector<ColumnTestEvent>& events, std::vector<uint8_t>& file) {
+    ColumnBlockEncoder encoder;
+    for (const ColumnTestEvent& event : events) {
+        encoder.append(reinterpret_cast<const EventRecord*>(event.record.data()), event.pid, event.process_name,
+                       event.path.empty() && event.pid % 2 == 0 ? nullptr : &event.path);
+    }
+    encoder.finish(ClockAnchor{});
+    const uint8_t* header = reinterpret_cast<const uint8_t*>(&encoder.header);
+    file.insert(file.end(), header, header + sizeof(encoder.header));
+    for (const std::vector<uint8_t>& column : encoder.columns) {
+        file.insert(file.end(), column.begin(), column.end());
+    }
+}
+
+// Function to test that a columnar block decodes to the events it was encoded from, that its header
+// indexes them, and that a truncated trailing block is rejected
+void testColumnarRoundTrip() {
+    const uint8_t opcodes[] = {OP_OPEN, OP_READ, OP_WRITE, OP_CLOSE, OP_MALLOC, OP_FREE, OP_OPENAT, OP_LSEEK, OP_MMAP};
+    const int64_t results[] = {-1, 0, 3, -100, INT64_MIN, INT64_MAX, 4096, -4096};
+    std::vector<ColumnTestEvent> events;
+    uint64_t random = 2463534242ull;
+    uint64_t timestamp = 1000000;
+    for (int index = 0; index < 3000; ++index) {
+        random ^= random << 13;
+        random ^= random >> 7;
+        random ^= random << 17;
+        ColumnTestEvent event;
+        uint32_t argument_count = random % (MAX_EVENT_ARGUMENTS + 1);
+        std::string string(index % 5 == 0 ? 0 : random % 40, static_cast<char>('a' + index % 26));
+        event.record.assign((eventLength(argument_count, string.size()) + sizeof(uint64_t) - 1) / sizeof(uint64_t), 0);
+        EventRecord* record = reinterpret_cast<EventRecord*>(event.record.data());
+        record->opcode = opcodes[random % sizeof(opcodes)];
+        record->argument_count = static_cast<uint8_t>(argument_count);
+        record->string_length = static_cast<uint16_t>(string.size());
+        record->tid = 5000 + random % 64;
+        // Timestamps of different rings interleave, so they may go backwards
+        timestamp = timestamp + random % 5000 - 1000;
+        record->timestamp = timestamp;
+        record->duration = random % 3 == 0 ? random : random % 1000;
+        record->result = index % 3 == 0 ? results[index % 8] : static_cast<int64_t>(random);
+        uint64_t* arguments = reinterpret_cast<uint64_t*>(record + 1);
+        for (uint32_t argument = 0; argument < argument_count; ++argument) {
+            arguments[argument] = argument % 2 == 0 ? static_cast<uint64_t>(-static_cast<int64_t>(random % 200)) : random >> argument;
+        }
+        memcpy(const_cast<char*>(eventString(record)), string.data(), string.size());
+        event.pid = 1000 + (random % 40) * 7;
+        event.process_name = "process-" + std::to_string(event.pid % 3);
+        event.path = index % 4 == 0 ? "" : "/var/log/file-" + std::to_string(index % 11);
+        events.push_back(std::move(event));
+    }
+
+    std::vector<uint8_t> file;
+    std::vector<ColumnTestEvent> second(events.begin() + 2000, events.end());
+    events.resize(2000);
+    encodeColumnBlock(events, file);
+    size_t second_offset = file.size();
+    encodeColumnBlock(second, file);
+
+    ColumnBlockHeader header;
+    handleError(!readColumnBlockHeader(file.data(), file.size(), 0, header), "Rejected a columnar block");
+    handleError(header.row_count != events.size() || sizeof(header) + header.block_size != second_offset,
+                "Wrong columnar block size");
+    uint64_t opcode_mask = 0;
+    uint64_t min_timestamp = UINT64_MAX;
+    uint64_t max_timestamp = 0;
+    uint32_t min_pid = UINT32_MAX;
+    uint32_t max_pid = 0;
+    std::vector<bool> pid_bits(PID_BITMAP_WORDS * 64, false);
+    for (const ColumnTestEvent& event : events) {
+        const EventRecord* record = reinterpret_cast<const EventRecord*>(event.record.data());
+        opcode_mask |= 1ull << record->opcode;
+        min_timestamp = std::min(min_timestamp, record->timestamp);
+        max_timestamp = std::max(max_timestamp, record->timestamp);
+        min_pid = std::min(min_pid, event.pid);
+        max_pid = std::max(max_pid, event.pid);
+        pid_bits[event.pid % (PID_BITMAP_WORDS * 64)] = true;
+    }
+    handleError(header.opcode_mask != opcode_mask, "Wrong columnar block opcode mask");
+    handleError(header.min_timestamp != min_timestamp || header.max_timestamp != max_timestamp,
+                "Wrong columnar block time range");
+    handleError(header.min_pid != min_pid || header.max_pid != max_pid, "Wrong columnar block PID range");
+    for (uint32_t pid = min_pid; pid <= max_pid + PID_BITMAP_WORDS * 64; ++pid) {
+        handleError(isPidInBitmap(header.pid_bitmap, pid) != pid_bits[pid % (PID_BITMAP_WORDS * 64)],
+                    "Wrong columnar block PID bitmap");
+    }
+
+    ColumnBlockDecoder decoder;
+    handleError(!decoder.open(&header, file.data() + sizeof(header)), "Failed to open a columnar block");
+    for (const ColumnTestEvent& event : events) {
+        uint32_t pid;
+        const char* process_name;
+        uint32_t process_name_length;
+        const char* path;
+        uint32_t path_length;
+        const EventRecord* decoded = decoder.next(pid, process_name, process_name_length, path, path_length);
+        const EventRecord* record = reinterpret_cast<const EventRecord*>(event.record.data());
+        handleError(decoded == NULL, "Columnar block ended early");
+        handleError(decoded->opcode != record->opcode || decoded->argument_count != record->argument_count ||
+                    decoded->string_length != record->string_length || decoded->tid != record->tid ||
+                    decoded->timestamp != record->timestamp || decoded->duration != record->duration ||
+                    decoded->result != record->result, "Wrong columnar event fields");
+        handleError(memcmp(eventArguments(decoded), eventArguments(record), record->argument_count * sizeof(uint64_t)) != 0 ||
+                    memcmp(eventString(decoded), eventString(record), record->string_length) != 0,
+                    "Wrong columnar event arguments or string");
+        handleError(pid != event.pid || std::string(process_name, process_name_length) != event.process_name ||
+                    std::string(path, path_length) != event.path, "Wrong columnar event process or path");
+    }
+    uint32_t pid;
+    const char* process_name;
+    uint32_t process_name_length;
+    const char* path;
+    uint32_t path_length;
+    handleError(decoder.next(pid, process_name, process_name_length, path, path_length) != NULL,
+                "Columnar block decoded extra rows");
+
+    // The query tool stops at the first block that does not fit in the file
+    handleError(!readColumnBlockHeader(file.data(), file.size(), second_offset, header) ||
+                header.row_count != second.size() || second_offset + sizeof(header) + header.block_size != file.size(),
+                "Rejected the trailing columnar block");
+    handleError(readColumnBlockHeader(file.data(), file.size() - 1, second_offset, header),
+                "Accepted a truncated columnar block");
+    handleError(readColumnBlockHeader(file.data(), second_offset + sizeof(header) - 1, second_offset, header),
+                "Accepted a truncated columnar block header");
+    handleError(readColumnBlockHeader(file.data(), file.size(), second_offset + 1, header),
+                "Accepted a columnar block at a wrong offset");
+}
+
+// Function to test the histogram bucket edges and the percentiles of known distributions
+void testLatencyHistogram() {
+    for (uint64_t value = 0; value < LATENCY_SUB_BUCKET_COUNT; ++value) {
+        handleError(latencyBucket(value) != value || latencyBucketHighestValue(value) != value,
+                    "Inexact latency bucket below the sub-bucket count");
+    }
+    // 128 and 129 share the first sub-bucket of width 2, 130 starts the next one
+    handleError(latencyBucket(128) != 128 || latencyBucket(129) != 128 || latencyBucket(130) != 129,
+                "Wrong latency buckets at the first power of two");
+    handleError(latencyBucket(255) + 1 != latencyBucket(256) || latencyBucketHighestValue(latencyBucket(256)) != 259,
+                "Wrong latency buckets at the second power of two");
+
+    // Every value lies within its bucket, above the previous bucket, and at most 1 / 64 below its top
+    std::vector<uint64_t> values;
+    for (uint32_t bit = LATENCY_SUB_BUCKET_BITS; bit < 64; ++bit) {
+        values.push_back((uint64_t(1) << bit) - 1);
+        values.push_back(uint64_t(1) << bit);
+        values.push_back((uint64_t(1) << bit) + 1);
+    }
+    values.push_back(UINT64_MAX);
+    uint64_t random = 88172645463325252ull;
+    for (int i = 0; i < 1000; ++i) {
+        random ^= random << 13;
+        random ^= random >> 7;
+        random ^= random << 17;
+        values.push_back(random >> (i % 64));
+    }
+    for (uint64_t value : values) {
+        uint32_t bucket = latencyBucket(value);
+        uint64_t highest = latencyBucketHighestValue(bucket);
+        handleError(highest < value || (bucket > 0 && latencyBucketHighestValue(bucket - 1) >= value),
+                    "Latency value outside its bucket");
+        handleError(highest - value > value / 64, "Latency bucket wider than 1 / 64 of its values");
+    }
+
+    LatencyHistogram empty;
+    handleError(empty.valueAtPercentile(50) != 0, "Percentile of an empty latency histogram");
+
+    // Exact below the sub-bucket count
+    LatencyHistogram small;
+    for (uint64_t value = 0; value < 100; ++value) {
+        small.record(value);
+    }
+    handleError(small.valueAtPercentile(50) != 49 || small.valueAtPercentile(99) != 98 ||
+                small.valueAtPercentile(100) != 99, "Wrong percentiles of small latencies");
+
+    LatencyHistogram uniform;
+    for (uint64_t value = 1; value <= 10000; ++value) {
+        uniform.record(value);
+    }
+    uint64_t p50 = uniform.valueAtPercentile(50);
+    uint64_t p99 = uniform.valueAtPercentile(99);
+    handleError(p50 < 5000 || p50 > 5000 + 5000 / 64, "Wrong p50 of uniform latencies");
+    handleError(p99 < 9900 || p99 > 9900 + 9900 / 64, "Wrong p99 of uniform latencies");
+    handleError(uniform.total_count != 10000 || uniform.max_value != 10000 || uniform.valueAtPercentile(100) != 10000,
+                "Wrong maximum of uniform latencies");
+
+    // A long tail: 1 % of the calls are 10000 times slower
+    LatencyHistogram tail;
+    for (int i = 0; i < 990; ++i) {
+        tail.record(100);
+    }
+    for (int i = 0; i < 10; ++i) {
+        tail.record(1000000);
+    }
+    handleError(tail.valueAtPercentile(50) != 100 || tail.valueAtPercentile(99) != 100,
+                "Wrong percentiles below the latency tail");
+    handleError(tail.valueAtPercentile(99.9) != 1000000 || tail.valueAtPercentile(100) != 1000000,
+                "Wrong percentiles in the latency tail");
+}
+
+// Function to test allocations freed by other threads, so a freed address is soon handed out
+// again to a concurrent malloc; every block is freed by the time it returns
+void testConcurrentAllocation() {
+    const int thread_count = 4;
+    const int iterations = 20000;
+    const size_t block_size = 8192;
+    static std::atomic<void*> exchange_slots[64];
+    std::vector<std::thread> threads;
+    for (int thread = 0; thread < thread_count; ++thread) {
+        threads.emplace_back([thread] {
+            for (int iteration = 0; iteration < iterations; ++iteration) {
+                void* block = malloc(block_size + (iteration % 16) * 16);
+                handleError(block == NULL, "Failed to allocate memory");
+                free(exchange_slots[(thread * 7 + iteration) % 64].exchange(block));
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    for (std::atomic<void*>& slot : exchange_slots) {
+        free(slot.exchange(NULL));
+    }
+}
+
+int main(int argc, char* argv[]) {
+    // Run on its own with a size filter by test_interceptor.sh, the daemon checks nothing stays live
+    if (argc > 1 && strcmp(argv[1], "concurrent") == 0) {
+        testConcurrentAllocation();
+        return 0;
+    }
+
+    auto start = std::chrono::high_resolution_clock::now();
+    // Test file I/O
+    testFileIO();
+
+    // Test dynamic memory allocation
+    testMemoryAllocation();
+
+    // Test memory reallocation
+    testMemoryReallocation();
+
+    // Test zeroed and aligned allocation
+    testAlignedAllocation();
+
+    // Test bootstrap arena alignment
+    testBootstrapArena();
+
+    // Test latency histogram buckets and percentiles
+    testLatencyHistogram();
+
+    // Test columnar block encoding, indexing and truncation
+    testColumnarRoundTrip();
+
+    auto end = std::chrono::high_resolution_clock::now();
+
+    std::chrono::duration<double> duration = end - start;
+    std::cout << "Exec time: " << duration.count() << " sec" << std::endl;
+    return 0;
 }
\ No newline at end of file